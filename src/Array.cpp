@@ -5,8 +5,23 @@
 #include "dr_wav.h" // for reading wav files
 
 #include "Widgets.hpp"
+#include "Util.hpp"
+#include "Spectral.hpp"
+#include "Wavetable.hpp"
+#include "PrefixSum.hpp"
+#include "Oversampling.hpp"
+#include "LaneStorage.hpp"
+#include "DiskRecorder.hpp"
+#include "Granular.hpp"
+#include "Convolver.hpp"
+#include "BlockRenderer.hpp"
+#include "Terrain.hpp"
+#include "ZeroCrossings.hpp"
+#include "Slices.hpp"
+#include "ArrayExpander.hpp"
 
 #include <iostream>
+#include <sstream> // std::istringstream
 
 //TODO: load buffer from text/csv file?
 //TODO: prevent audio clicking at the last sample
@@ -48,6 +63,7 @@ struct Array : Module {
 	enum RecordingMode {
 		GATE,
 		TOGGLE,
+		CAPTURE,
 		NUM_REC_MODES
 	};
 
@@ -58,19 +74,277 @@ struct Array : Module {
 		NUM_DATA_SAVING_MODES,
 	};
 
+	enum PositionMode {
+		POSITION_INPUT,
+		POSITION_OSCILLATOR,
+		POSITION_DELAY,
+		POSITION_GRANULAR,
+		POSITION_PLAYER,
+		NUM_POSITION_MODES
+	};
+
+	enum SpectralOperation {
+		SPECTRAL_LOWPASS,
+		SPECTRAL_HIGHPASS,
+		SPECTRAL_SMOOTH,
+		SPECTRAL_SINESUM,
+		SPECTRAL_COSINESUM,
+	};
+
 	float phases[MAX_POLY_CHANNELS];
+	float prevPhases[MAX_POLY_CHANNELS];
+	// Phase increment per sample, used for choosing the wavetable mip level
+	float phaseDeltas[MAX_POLY_CHANNELS];
+	// Phase accumulators of the internal oscillator. Double precision, so
+	// that low frequencies don't drift even with a large array.
+	double oscPhases[MAX_POLY_CHANNELS];
 	int nChannels = 1;
 	float recPhase = 0.f;
-	float sampleRate; // so that it can be read by the UI
+	float sampleRate = 44100.f; // so that it can be read by the UI
 	RecordingMode recMode = GATE;
 	dsp::SchmittTrigger recTrigger;
 	dsp::SchmittTrigger recClickTrigger;
 	bool isRecording = false;
+
+	// In tape mode, the recorded signal is written to a wav file on disk, and
+	// the array shows the most recent part of it.
+	bool tapeMode = false;
+	std::string tapeDirectory; // empty for the patch storage folder
+	DiskRecorder tape;
+	bool tapeRecording = false;
+	int tapeChannels = 1;
+	int tapeHead = 0;
+
+	// In delay mode, the next element to be written
+	int delayHead = 0;
+
+	// In capture mode, the next element to be written, or -1 if not capturing
+	int captureIndex = -1;
+	dsp::PulseGenerator captureEndPulse;
+
+	// In granular mode, each channel of POS sets the start position of the
+	// grains of one voice.
+	GrainWindow grainWindow;
+	GrainVoice grainVoices[MAX_POLY_CHANNELS];
+	int grainArraySize = 0; // array size when the grains were started
+
+	// In sample player mode, a rising edge on each channel of the GATE input
+	// of the expander plays the read window of that voice once from the
+	// start, at a rate set by POS as V/Oct. The position (in elements) is
+	// split into an integer and a fractional part, so that it stays exact in
+	// single precision even with long samples.
+	float playerIndices[MAX_POLY_CHANNELS];
+	float playerFracs[MAX_POLY_CHANNELS];
+	float playerActive[MAX_POLY_CHANNELS]; // 1 while the voice is playing
+	float playerPrevGates[MAX_POLY_CHANNELS];
+	// The voices are stopped when the player mode is selected
+	PositionMode activePositionMode = POSITION_INPUT;
+	dsp::TSchmittTrigger<float_4> playerTriggers[MAX_POLY_CHANNELS / 4];
 	std::vector<float> buffer;
+	// With more than one lane, Array holds several arrays of the same size,
+	// which are output on separate channels. Lane 0 is the buffer, which is
+	// shown on the display and used by the editing and processing features,
+	// the other lanes are stored in extraLanes. Both are used by the engine
+	// thread, see pendingLanes for changing them.
+	int numLanes = 1;
+	LaneStorage extraLanes;
+	// The resized lanes are written here by resizeLanes(), and swapped into
+	// extraLanes by process(), like pendingBuffer, so that the engine never
+	// reads lanes that are being reallocated. The old lanes are freed by the
+	// next resize.
+	LaneStorage pendingLanes;
+	int pendingNumLanes = 1;
+	std::atomic<bool> pendingLanesReady{false};
 	std::string lastLoadedPath;
 	bool enableEditing = true;
 	DataSaveMode saveMode = SAVE_FULL_DATA;
 	InterpBoundaryMode boundaryMode = INTERP_PERIODIC;
+	PositionMode positionMode = POSITION_INPUT;
+
+	// Antiderivative anti-aliasing of the interpolated output
+	bool antiAliasing = false;
+	// Running integral of the interpolated array, the value at i is the
+	// integral up to element i. The table is built by the worker thread when
+	// the array is resized or the settings change, and kept up to date on the
+	// engine thread while recording or editing, see syncIntegral().
+	struct IntegralTable {
+		PrefixSum sums;
+		InterpBoundaryMode boundaryMode;
+	};
+	Mailbox<IntegralTable> integralMailbox;
+	IntegralTable *integral = nullptr; // the table in use by the engine
+	std::atomic<bool> integralRequested{false};
+	bool integralPending = false; // requested and not received yet
+	DirtyRange integralDirty;
+	// Modified range since the worker started building the last table
+	DirtyRange integralWorkerDirty;
+	// Larger changes are left to the worker instead of updating the table on
+	// the engine thread
+	static const int MAX_INCREMENTAL_UPDATE = 4096;
+	// Position (in elements) and integral at the previous sample
+	double adaaPrevPos[MAX_POLY_CHANNELS];
+	double adaaPrevF[MAX_POLY_CHANNELS];
+	int adaaChannels = 0; // number of channels with valid previous values
+	bool integralModified = false;
+	// Whether the windowed average output uses the integral
+	bool averageActive = false;
+
+	// Store the polynomial coefficients of each segment of the interpolated
+	// output, instead of computing them on every sample. Segment i is stored
+	// at 4 * i as (b, k1, k2, k3), see tabread4Coefficients(). Like the
+	// integral, the table is built by the worker and kept up to date on the
+	// engine thread, see syncCoefficients().
+	bool cacheCoefficients = false;
+	struct CoefficientTable {
+		std::vector<float> k;
+		InterpBoundaryMode boundaryMode;
+	};
+	Mailbox<CoefficientTable> coefficientsMailbox;
+	CoefficientTable *coefficients = nullptr; // the table in use by the engine
+	bool coefficientsReady = false; // whether the table matches the array
+	std::atomic<bool> coefficientsRequested{false};
+	bool coefficientsPending = false; // requested and not received yet
+	DirtyRange coefficientsDirty;
+	// Modified range since the worker started building the last table
+	DirtyRange coefficientsWorkerDirty;
+	bool workerCoefficientsPosted = false; // only used by the worker
+
+	// Oversampling factor of the interpolated output (1, 2, 4 or 8)
+	int oversampling = 1;
+	int activeOversampling = 1;
+	oversampling::Upsampler<2> upsampler2[MAX_POLY_CHANNELS / 4];
+	oversampling::Upsampler<4> upsampler4[MAX_POLY_CHANNELS / 4];
+	oversampling::Upsampler<8> upsampler8[MAX_POLY_CHANNELS / 4];
+	oversampling::Decimator<2> decimator2[MAX_POLY_CHANNELS / 4];
+	oversampling::Decimator<4> decimator4[MAX_POLY_CHANNELS / 4];
+	oversampling::Decimator<8> decimator8[MAX_POLY_CHANNELS / 4];
+
+	// Steps down the oversampling and ADAA settings when processing takes too
+	// long, see governedOversampling() and governedAntiAliasing()
+	QualityGovernor governor;
+
+	// In block mode, POS is buffered for BLOCK_MODE_SIZE samples, and the
+	// array is read for the whole block at once, four samples at a time. This
+	// avoids the overhead of processing every sample separately for mono
+	// waveshaping, but delays the output by the size of the block. It's only
+	// used when the settings allow it, see canProcessBlocks().
+	static const int BLOCK_MODE_SIZE = 16;
+	bool blockProcessing = false;
+	bool blockActive = false;
+	int blockPos = 0;
+	float blockIn[BLOCK_MODE_SIZE];
+	float blockStep[BLOCK_MODE_SIZE];
+	float blockSmooth[BLOCK_MODE_SIZE];
+	// Edges of the REC input and button in block mode, which end the block
+	// mode and are handled by processSample() on the same sample
+	bool blockRecTriggered = false;
+	bool blockRecClicked = false;
+
+	// In CV rate mode, the array is read only every cvRate samples, and the
+	// smooth output ramps linearly to the new value until the next read, so
+	// it lags behind POS by up to cvRate samples. 1 means that CV rate mode is
+	// off, CV_RATE_ADAPTIVE reads once for every element that POS moves.
+	static const int CV_RATE_ADAPTIVE = 0;
+	static const int CV_RATE_MAX_INTERVAL = 64;
+	int cvRate = 1;
+	int cvCounter = 0; // samples until the next read
+	int cvChannels = 0; // number of channels with valid ramps
+	float cvValues[MAX_POLY_CHANNELS];
+	float cvIncrements[MAX_POLY_CHANNELS];
+	float cvSteps[MAX_POLY_CHANNELS];
+	float cvSlopes[MAX_POLY_CHANNELS];
+
+	// In wavetable mode, the buffer is split into this many single-cycle
+	// frames. 1 means that wavetable mode is off.
+	int wavetableFrames = 1;
+
+	// Held while the buffer is reallocated outside of the engine thread, and
+	// while a worker thread reads it.
+	std::mutex bufferMutex;
+	// Modified ranges of the buffer, for rebuilding derived tables
+	DirtyRange wavetableDirty;
+	// Band-limited wavetable, built by the worker thread
+	Mailbox<Wavetable> wavetableMailbox;
+	std::unique_ptr<Wavetable> workerWavetable; // only used by the worker
+	RepostThrottle wavetableThrottle;
+
+	// In wave terrain mode, the buffer is a grid with this many rows, which
+	// is read with POS as X and the Y input of the expander. 1 means that
+	// wave terrain mode is off.
+	int terrainRows = 1;
+	bool terrainBicubic = true;
+	DirtyRange terrainDirty;
+	// Tiled copy of the grid, built by the worker thread
+	Mailbox<Terrain> terrainMailbox;
+	std::unique_ptr<Terrain> workerTerrain; // only used by the worker
+	RepostThrottle terrainThrottle;
+
+	// Snap jumps of POS to the nearest zero crossing, to avoid clicks when
+	// jumping around in a sample. After a jump, playback continues from the
+	// zero crossing, i.e. offset from POS by snapOffsets (in elements).
+	bool snapToZero = false;
+	float snapOffsets[MAX_POLY_CHANNELS];
+	float snapPrevPos[MAX_POLY_CHANNELS];
+	// POS jumps when it moves by more than SNAP_JUMP_RATIO times its recent
+	// speed (in elements per sample), and by at least SNAP_MIN_JUMP elements.
+	// This catches both the loop point of a slow ramp and short jumps in a
+	// long sample.
+	static constexpr float SNAP_JUMP_RATIO = 8.f;
+	static constexpr float SNAP_MIN_JUMP = 4.f;
+	float snapSpeeds[MAX_POLY_CHANNELS];
+	DirtyRange zeroCrossingsDirty;
+	Mailbox<ZeroCrossings> zeroCrossingsMailbox;
+	// The settings of the last posted index, only used by the worker
+	int workerZeroCrossingsSize = -1;
+	float workerZeroCrossingsZero = -1.f;
+
+	// The part of the array that is covered by POS, set by the START and
+	// LENGTH inputs of the expander, in elements. The boundary modes apply at
+	// the ends of the window. The whole array by default.
+	int readStart[MAX_POLY_CHANNELS];
+	int readLength[MAX_POLY_CHANNELS];
+	int readWindowSize = -1; // array size when the window was last updated
+	// The inputs are only read at control rate
+	dsp::ClockDivider readWindowDivider;
+
+	// When the SLICE input of the expander is connected, the array is split
+	// into slices at the detected onsets, and POS plays the selected slice.
+	// Set by the engine and read by the worker.
+	std::atomic<bool> slicesActive{false};
+	DirtyRange slicesDirty;
+	Mailbox<Slices> slicesMailbox;
+	// The settings of the last posted slices, only used by the worker
+	int workerSlicesSize = -1;
+	float workerSlicesZero = -1.f;
+	// The array has been modified since the last analysis
+	bool workerSlicesStale = false;
+
+	// In convolution mode, REC IN is convolved with the array
+	bool convolution = false;
+	DirtyRange convolutionDirty;
+	// Partitioned impulse response, built by the worker thread
+	Mailbox<ConvolutionKernel> convolutionMailbox;
+	std::unique_ptr<ConvolutionKernel> workerKernel; // only used by the worker
+	RepostThrottle kernelThrottle;
+	Convolver convolver;
+	// Optionally, the convolver runs on a separate thread, which adds
+	// latency, see BlockRenderer::latencyFor(). Declared after everything
+	// the render thread uses, so that it's stopped first.
+	bool convolutionOnWorker = false;
+	BlockRenderer convolutionRenderer;
+
+	// Settings for the spectral processing menu
+	float spectralCutoff = 1000.f; // Hz
+	float smoothingWidth = 10.f; // samples
+	std::string harmonics = "1 0.5 0.333 0.25";
+
+	// The result of a spectral operation is written here by the background
+	// job, and swapped into the buffer by process().
+	std::vector<float> pendingBuffer;
+	std::atomic<bool> pendingBufferReady{false};
+	// Declared after pendingBuffer, so that the job is joined before the
+	// buffer it writes to is destroyed.
+	BackgroundJob spectralJob;
 
 	// If the array size is smaller than this, serialize as JSON, otherwise
 	// serialize as wav in the patch storage folder. Floats are serialized in
@@ -80,11 +354,77 @@ struct Array : Module {
 	const static std::string arrayDataFileName;
 
 	void initBuffer() {
+		std::lock_guard<std::mutex> lock(bufferMutex);
 		buffer.clear();
 		int default_steps = 10;
 		for(int i = 0; i < default_steps; i++) {
 			buffer.push_back(i / (default_steps - 1.f));
 		}
+		resizeLanes(getNewNumLanes());
+		markDirty(0, buffer.size());
+	}
+
+	// A lane as used by the engine thread
+	float *getLane(int lane) {
+		return lane == 0 ? buffer.data() : extraLanes.lane(lane - 1);
+	}
+
+	// The number of lanes and a lane as they will be after the pending
+	// resize, for the other threads. The bufferMutex must be held while
+	// accessing the lanes.
+	int getNewNumLanes() {
+		return pendingLanesReady ? pendingNumLanes : numLanes;
+	}
+
+	float *getNewLane(int lane) {
+		if(lane == 0) return buffer.data();
+		return (pendingLanesReady ? pendingLanes : extraLanes).lane(lane - 1);
+	}
+
+	// Set the number of lanes, and make their size match the buffer. The
+	// bufferMutex must be held, and the new lanes must be accessed with
+	// getNewLane() until process() has swapped them in.
+	void resizeLanes(int n) {
+		LaneStorage &current = pendingLanesReady ? pendingLanes : extraLanes;
+		pendingLanes.resizeFrom(current, n - 1, buffer.size(), getZeroValue());
+		pendingNumLanes = n;
+		pendingLanesReady = true;
+	}
+
+	// The render thread only runs when it's used
+	void updateConvolutionRenderer() {
+		convolutionRenderer.setActive(convolution && convolutionOnWorker);
+	}
+
+	// The disk writer thread only runs in tape mode
+	void setTapeMode(bool on) {
+		tape.setActive(on);
+		tapeMode = on;
+	}
+
+	void setNumLanes(int n) {
+		std::lock_guard<std::mutex> lock(bufferMutex);
+		resizeLanes(clamp(n, 1, MAX_POLY_CHANNELS));
+	}
+
+	// Large arrays are saved as a wav file instead of JSON
+	bool serializeAsWav() {
+		return buffer.size() * getNewNumLanes() > directSerializationThreshold;
+	}
+
+	// Should be called whenever the buffer contents are modified, so that the
+	// tables derived from the buffer are kept up to date. See also
+	// markRecorded(), which should be kept in sync with this.
+	void markDirty(size_t lo, size_t hi) {
+		wavetableDirty.mark(lo, hi);
+		convolutionDirty.mark(lo, hi);
+		terrainDirty.mark(lo, hi);
+		zeroCrossingsDirty.mark(lo, hi);
+		slicesDirty.mark(lo, hi);
+		integralDirty.mark(lo, hi);
+		integralWorkerDirty.mark(lo, hi);
+		coefficientsDirty.mark(lo, hi);
+		coefficientsWorkerDirty.mark(lo, hi);
 	}
 
 	Array() {
@@ -112,11 +452,175 @@ struct Array : Module {
 		configBypass(REC_SIGNAL_INPUT, STEP_OUTPUT);
 		configBypass(REC_SIGNAL_INPUT, INTERP_OUTPUT);
 
-		for(int i = 0; i < MAX_POLY_CHANNELS; i++) phases[i] = 0.f;
+		for(int i = 0; i < MAX_POLY_CHANNELS; i++) {
+			phases[i] = 0.f;
+			prevPhases[i] = 0.f;
+			phaseDeltas[i] = 0.f;
+			oscPhases[i] = 0.0;
+			adaaPrevPos[i] = 0.0;
+			adaaPrevF[i] = 0.0;
+			snapOffsets[i] = 0.f;
+			snapPrevPos[i] = 0.f;
+			snapSpeeds[i] = 0.f;
+			readStart[i] = 0;
+			readLength[i] = 1;
+			cvValues[i] = 0.f;
+			cvIncrements[i] = 0.f;
+			cvSteps[i] = 0.f;
+			cvSlopes[i] = 0.f;
+		}
+		resetPlayer();
+		readWindowDivider.setDivision(32);
+		convolutionRenderer.setup(1, 2, [this](const float *in, float *out, int frames) {
+			// The engine thread doesn't use the convolver or its mailbox while
+			// the renderer is running.
+			for(int i = 0; i < frames; i++) {
+				out[2 * i] = convolver.process(in[i], convolutionMailbox.get(), out[2 * i + 1]);
+			}
+		});
+		governor.numTiers = NUM_QUALITY_TIERS;
 		initBuffer();
+
+		// The background tables are built on the worker thread shared by all
+		// Arrays
+		SharedWorker::get().add(this, [this]() { workerStep(); });
+	}
+
+	~Array() {
+		// before anything the worker uses is destroyed
+		SharedWorker::get().remove(this);
 	}
 
 	void process(const ProcessArgs &args) override;
+	void processSample(const ProcessArgs &args);
+	bool processBlockSample();
+	bool canProcessBlocks();
+	void processBlock();
+
+	// The voltage range selected by one of the range switches
+	void getRange(int paramId, float &min, float &max) {
+		float value = params[paramId].getValue();
+		if(value > 1.5f) {
+			min = 0.f;
+			max = 10.f;
+		} else if(value > 0.5f) {
+			min = -5.f;
+			max =  5.f;
+		} else {
+			min = -10.f;
+			max =  10.f;
+		}
+	}
+
+	// The quality tiers of the governor, from the highest to the lowest
+	static const int NUM_QUALITY_TIERS = 5;
+
+	int governedOversampling(int tier) {
+		static const int maxFactors[NUM_QUALITY_TIERS] = {8, 4, 2, 1, 1};
+		return std::min(oversampling, maxFactors[tier]);
+	}
+
+	bool governedAntiAliasing(int tier) {
+		return antiAliasing && tier < NUM_QUALITY_TIERS - 1;
+	}
+
+	int governedOversampling() { return governedOversampling(governor.tier); }
+	bool governedAntiAliasing() { return governedAntiAliasing(governor.tier); }
+
+	// The tiers that don't change anything with the current settings, e.g.
+	// all of them when oversampling and ADAA are off
+	uint32_t redundantQualityTiers() {
+		uint32_t mask = 0;
+		for(int t = 1; t < NUM_QUALITY_TIERS; t++) {
+			if(governedOversampling(t) == governedOversampling(t - 1) && governedAntiAliasing(t) == governedAntiAliasing(t - 1)) {
+				mask |= 1u << t;
+			}
+		}
+		return mask;
+	}
+
+	void resetPlayer() {
+		for(int i = 0; i < MAX_POLY_CHANNELS; i++) {
+			playerIndices[i] = 0.f;
+			playerFracs[i] = 0.f;
+			playerActive[i] = 0.f;
+			playerPrevGates[i] = 0.f;
+		}
+		for(int i = 0; i < MAX_POLY_CHANNELS / 4; i++) {
+			playerTriggers[i].reset();
+		}
+	}
+
+	void updatePhasesFromInput(float phaseMin, float phaseMax);
+	void updateOscillator(float sampleTime, ArrayExpander *expander);
+	void updatePlayer(ArrayExpander *expander);
+	void processWavetable(const Wavetable &wt, ArrayExpander *expander, float inOutMin, float inOutMax);
+	void processLanes(Output *slopeOutput, float inOutMin, float inOutMax);
+	bool syncIntegral();
+	void requestIntegral();
+	bool takeIntegralModified();
+	void updateIntegralRange(int lo, int hi);
+	void buildIntegral();
+	bool syncCoefficients();
+	void requestCoefficients();
+	void updateCoefficientsRange(int lo, int hi);
+	void buildCoefficients();
+	void record(float phaseMin, float phaseMax, float inOutMin, float inOutMax);
+	void recordTape(float inOutMin, float inOutMax);
+	void writeFrame(int i, float inOutMin, float inOutMax);
+	void writeDelay(float inOutMin, float inOutMax);
+	void processDelay(float inOutMin, float inOutMax);
+	void processGranular(float sampleTime, ArrayExpander *expander, float inOutMin, float inOutMax);
+	void processPlayer(float inOutMin, float inOutMax);
+	void markRecorded(int i);
+	void updateSegment(int i);
+	double integralAt(double pos);
+	float interpolateAt(double pos);
+	float antiAliasedRead(int chan, double pos);
+	float windowAverage(double center, double width);
+	void processAverage(ArrayExpander *expander, float inOutMin, float inOutMax);
+	float_4 interpolate4(float_4 phase, int c);
+	template <int FACTOR>
+	void processOversampled(oversampling::Upsampler<FACTOR> *upsamplers, oversampling::Decimator<FACTOR> *decimators, bool adaa, float inOutMin, float inOutMax);
+	void processControlRate(Output *slopeOutput, float inOutMin, float inOutMax);
+	void processConvolution();
+	void snapJumps();
+	void updateReadWindow(ArrayExpander *expander);
+	void selectSlices(ArrayExpander *expander);
+	void processInverse(ArrayExpander *expander, float phaseMin, float phaseMax, float inOutMin, float inOutMax);
+	void processTerrain(const Terrain &terrain, ArrayExpander *expander, float phaseMin, float phaseMax, float inOutMin, float inOutMax);
+	void workerStep();
+	void buildWavetable();
+	void buildConvolutionKernel();
+	void postConvolutionKernel();
+	void buildTerrain();
+	void buildZeroCrossings();
+	void buildSlices();
+
+	ArrayExpander *getExpander() {
+		Module *m = rightExpander.module;
+		return m && m->model == modelArrayExpander ? static_cast<ArrayExpander*>(m) : nullptr;
+	}
+
+	// Update port names according to the current settings
+	void updatePortLabels() {
+		if(positionMode == POSITION_OSCILLATOR) {
+			inputInfos[PHASE_INPUT]->name = "Oscillator V/Oct pitch";
+		} else if(positionMode == POSITION_DELAY) {
+			inputInfos[PHASE_INPUT]->name = "Delay time";
+		} else if(positionMode == POSITION_GRANULAR) {
+			inputInfos[PHASE_INPUT]->name = "Grain position";
+		} else if(positionMode == POSITION_PLAYER) {
+			inputInfos[PHASE_INPUT]->name = "Sample player V/Oct pitch";
+		} else {
+			inputInfos[PHASE_INPUT]->name = "Playback position";
+		}
+	}
+
+	// Called by the context menu after a setting has been changed
+	void onSettingChanged() {
+		updatePortLabels();
+	}
 
 	float getZeroValue() {
 		// The buffer internal values are always 0..1. Depending on the
@@ -127,9 +631,74 @@ struct Array : Module {
 	}
 
 	void resizeBuffer(unsigned int newSize) {
+		std::lock_guard<std::mutex> lock(bufferMutex);
 		buffer.resize(newSize, getZeroValue());
+		resizeLanes(getNewNumLanes());
+		markDirty(0, buffer.size());
 	}
 
+	// Map an index outside the array into the array according to the
+	// boundary mode, consistently with the interpolation in process().
+	static int boundaryIndex(int i, int size, InterpBoundaryMode mode) {
+		if(i >= 0 && i < size) return i;
+		switch(mode) {
+			case INTERP_CONSTANT:
+				return clamp(i, 0, size - 1);
+			case INTERP_MIRROR:
+				{
+					if(size < 2) return 0;
+					int period = 2 * size - 2;
+					int m = eucMod(i, period);
+					return m < size ? m : period - m;
+				}
+			case INTERP_PERIODIC:
+			default:
+				return eucMod(i, size);
+		}
+	}
+
+	// Indices of the four array elements used for interpolating between
+	// elements i and i + 1.
+	void getInterpIndices(int i, int size, int &ia, int &ib, int &ic, int &id) {
+		getInterpIndices(i, size, boundaryMode, ia, ib, ic, id);
+	}
+
+	static void getInterpIndices(int i, int size, InterpBoundaryMode mode, int &ia, int &ib, int &ic, int &id) {
+		switch(mode) {
+			case INTERP_CONSTANT:
+				{
+					ia = clamp(i - 1, 0, size - 1);
+					ib = clamp(i + 0, 0, size - 1);
+					ic = clamp(i + 1, 0, size - 1);
+					id = clamp(i + 2, 0, size - 1);
+					break;
+				}
+			case INTERP_MIRROR:
+				{
+					ia = i < 1 ? 1 : i - 1;
+					ib = i;
+					ic = i + 1 < size ? i + 1 : size - 1;
+					id = i + 2 < size ? i + 2 : 2*size - (i + 3);
+					break;
+				}
+			case INTERP_PERIODIC:
+			default:
+				{
+					ia = (i - 1 + size) % size;
+					ib = (i + 0) % size;
+					ic = (i + 1) % size;
+					id = (i + 2) % size;
+					break;
+				}
+		}
+	}
+
+	bool isSpectralJobBusy() {
+		return spectralJob.isRunning() || pendingBufferReady;
+	}
+
+	bool startSpectralJob(SpectralOperation op);
+
 	size_t numFadeSamples() {
 		// Calculate the clicking prevention fade size (in samples)
 		// based on the current buffer size.
@@ -141,7 +710,7 @@ struct Array : Module {
 		}
 	}
 
-	void loadSample(std::string path, bool resizeBuf = false);
+	void loadSample(std::string path, bool resizeBuf = false, bool loadLanes = false);
 	void saveWav(std::string path);
 
 	json_t *dataToJson() override {
@@ -150,12 +719,31 @@ struct Array : Module {
 		json_object_set_new(root, "boundaryMode", json_integer(boundaryMode));
 		json_object_set_new(root, "recMode", json_integer(recMode));
 		json_object_set_new(root, "lastLoadedPath", json_string(lastLoadedPath.c_str()));
+		json_object_set_new(root, "spectralCutoff", json_real(spectralCutoff));
+		json_object_set_new(root, "smoothingWidth", json_real(smoothingWidth));
+		json_object_set_new(root, "harmonics", json_string(harmonics.c_str()));
+		json_object_set_new(root, "wavetableFrames", json_integer(wavetableFrames));
+		json_object_set_new(root, "terrainRows", json_integer(terrainRows));
+		json_object_set_new(root, "terrainBicubic", json_boolean(terrainBicubic));
+		json_object_set_new(root, "positionMode", json_integer(positionMode));
+		json_object_set_new(root, "antiAliasing", json_boolean(antiAliasing));
+		json_object_set_new(root, "oversampling", json_integer(oversampling));
+		json_object_set_new(root, "cvRate", json_integer(cvRate));
+		json_object_set_new(root, "blockProcessing", json_boolean(blockProcessing));
+		json_object_set_new(root, "qualityBudget", json_real(governor.budget));
+		json_object_set_new(root, "cacheCoefficients", json_boolean(cacheCoefficients));
+		json_object_set_new(root, "numLanes", json_integer(getNewNumLanes()));
+		json_object_set_new(root, "tapeMode", json_boolean(tapeMode));
+		json_object_set_new(root, "tapeDirectory", json_string(tapeDirectory.c_str()));
+		json_object_set_new(root, "convolution", json_boolean(convolution));
+		json_object_set_new(root, "convolutionOnWorker", json_boolean(convolutionOnWorker));
+		json_object_set_new(root, "snapToZero", json_boolean(snapToZero));
 
 		// we want to delete the wav file created by onSave in most cases, see below
 		bool deleteWavFile = true;
 
 		if(saveMode == SAVE_FULL_DATA) {
-			if(buffer.size() <= directSerializationThreshold) {
+			if(!serializeAsWav()) {
 
 				json_t *arr = json_array();
 				for(float x : buffer) {
@@ -164,6 +752,20 @@ struct Array : Module {
 				json_object_set(root, "arrayData", arr);
 				json_decref(arr);
 
+				std::lock_guard<std::mutex> lock(bufferMutex);
+				if(getNewNumLanes() > 1) {
+					json_t *lanes = json_array();
+					for(int l = 1; l < getNewNumLanes(); l++) {
+						json_t *lane = json_array();
+						const float *x = getNewLane(l);
+						for(size_t i = 0; i < buffer.size(); i++) {
+							json_array_append_new(lane, json_real(x[i]));
+						}
+						json_array_append_new(lanes, lane);
+					}
+					json_object_set_new(root, "laneData", lanes);
+				}
+
 			} else {
 				deleteWavFile = false;
 			}
@@ -189,6 +791,26 @@ struct Array : Module {
 		json_t *recMode_J = json_object_get(root, "recMode");
 		json_t *arrayData_J = json_object_get(root, "arrayData");
 		json_t *lastLoadedPath_J = json_object_get(root, "lastLoadedPath");
+		json_t *spectralCutoff_J = json_object_get(root, "spectralCutoff");
+		json_t *smoothingWidth_J = json_object_get(root, "smoothingWidth");
+		json_t *harmonics_J = json_object_get(root, "harmonics");
+		json_t *wavetableFrames_J = json_object_get(root, "wavetableFrames");
+		json_t *terrainRows_J = json_object_get(root, "terrainRows");
+		json_t *terrainBicubic_J = json_object_get(root, "terrainBicubic");
+		json_t *positionMode_J = json_object_get(root, "positionMode");
+		json_t *antiAliasing_J = json_object_get(root, "antiAliasing");
+		json_t *convolution_J = json_object_get(root, "convolution");
+		json_t *convolutionOnWorker_J = json_object_get(root, "convolutionOnWorker");
+		json_t *snapToZero_J = json_object_get(root, "snapToZero");
+		json_t *oversampling_J = json_object_get(root, "oversampling");
+		json_t *cvRate_J = json_object_get(root, "cvRate");
+		json_t *blockProcessing_J = json_object_get(root, "blockProcessing");
+		json_t *qualityBudget_J = json_object_get(root, "qualityBudget");
+		json_t *cacheCoefficients_J = json_object_get(root, "cacheCoefficients");
+		json_t *numLanes_J = json_object_get(root, "numLanes");
+		json_t *laneData_J = json_object_get(root, "laneData");
+		json_t *tapeMode_J = json_object_get(root, "tapeMode");
+		json_t *tapeDirectory_J = json_object_get(root, "tapeDirectory");
 
 		if(enableEditing_J) {
 			enableEditing = json_boolean_value(enableEditing_J);
@@ -208,14 +830,98 @@ struct Array : Module {
 		if(lastLoadedPath_J) {
 			lastLoadedPath = std::string(json_string_value(lastLoadedPath_J));
 		}
+		if(spectralCutoff_J) {
+			spectralCutoff = json_real_value(spectralCutoff_J);
+		}
+		if(smoothingWidth_J) {
+			smoothingWidth = json_real_value(smoothingWidth_J);
+		}
+		if(harmonics_J) {
+			harmonics = std::string(json_string_value(harmonics_J));
+		}
+		if(wavetableFrames_J) {
+			wavetableFrames = std::max(int(json_integer_value(wavetableFrames_J)), 1);
+		}
+		if(terrainRows_J) {
+			terrainRows = std::max(int(json_integer_value(terrainRows_J)), 1);
+		}
+		if(terrainBicubic_J) {
+			terrainBicubic = json_boolean_value(terrainBicubic_J);
+		}
+		if(positionMode_J) {
+			int pm = int(json_integer_value(positionMode_J));
+			if(pm < NUM_POSITION_MODES) {
+				positionMode = static_cast<PositionMode>(pm);
+			}
+		}
+		if(antiAliasing_J) {
+			antiAliasing = json_boolean_value(antiAliasing_J);
+		}
+		if(convolution_J) {
+			convolution = json_boolean_value(convolution_J);
+		}
+		if(convolutionOnWorker_J) {
+			convolutionOnWorker = json_boolean_value(convolutionOnWorker_J);
+		}
+		updateConvolutionRenderer();
+		if(snapToZero_J) {
+			snapToZero = json_boolean_value(snapToZero_J);
+		}
+		if(tapeMode_J) {
+			setTapeMode(json_boolean_value(tapeMode_J));
+		}
+		if(tapeDirectory_J) {
+			tapeDirectory = std::string(json_string_value(tapeDirectory_J));
+			// The patch storage folder needs an ID, otherwise onAdd() sets the
+			// directory.
+			if(id >= 0) {
+				updateTapeDirectory();
+			}
+		}
+		if(cacheCoefficients_J) {
+			cacheCoefficients = json_boolean_value(cacheCoefficients_J);
+		}
+		if(oversampling_J) {
+			int os = json_integer_value(oversampling_J);
+			if(os == 1 || os == 2 || os == 4 || os == 8) {
+				oversampling = os;
+			}
+		}
+		if(cvRate_J) {
+			int r = json_integer_value(cvRate_J);
+			if(r == CV_RATE_ADAPTIVE || r == 1 || r == 4 || r == 16 || r == 64) {
+				cvRate = r;
+			}
+		}
+		if(blockProcessing_J) {
+			blockProcessing = json_boolean_value(blockProcessing_J);
+		}
+		if(qualityBudget_J) {
+			governor.budget = clamp((float) json_real_value(qualityBudget_J), 0.f, 1.f);
+		}
+		updatePortLabels();
+		setNumLanes(numLanes_J ? json_integer_value(numLanes_J) : 1);
 
 		if(json_array_size(arrayData_J) > 0) {
+			std::lock_guard<std::mutex> lock(bufferMutex);
 			buffer.clear();
 			size_t i;
 			json_t *val;
 			json_array_foreach(arrayData_J, i, val) {
 				buffer.push_back(json_real_value(val));
 			}
+			resizeLanes(getNewNumLanes());
+			size_t l;
+			json_t *lane_J;
+			json_array_foreach(laneData_J, l, lane_J) {
+				if(int(l) + 1 >= getNewNumLanes()) break;
+				float *x = getNewLane(l + 1);
+				json_array_foreach(lane_J, i, val) {
+					if(i >= buffer.size()) break;
+					x[i] = json_real_value(val);
+				}
+			}
+			markDirty(0, buffer.size());
 			saveMode = SAVE_FULL_DATA;
 		} else if(json_string_value(arrayData_J) != NULL) {
 			lastLoadedPath = std::string(json_string_value(arrayData_J));
@@ -230,7 +936,12 @@ struct Array : Module {
 		// else, arrayData was missing from JSON, so we assume it's loaded from wav file in patch storage folder
 	}
 
+	void updateTapeDirectory() {
+		tape.setDirectory(tapeDirectory.empty() ? createPatchStorageDirectory() : tapeDirectory);
+	}
+
 	void onAdd(const AddEvent& e) override {
+		updateTapeDirectory();
 		std::string path = system::join(createPatchStorageDirectory(), arrayDataFileName);
 		if(system::isFile(path)) {
 			// if the file exists, we assume that we're supposed to load the
@@ -241,7 +952,7 @@ struct Array : Module {
 	}
 
 	void onSave(const SaveEvent& e) override {
-		if(buffer.size() > directSerializationThreshold) {
+		if(serializeAsWav()) {
 			std::string path = system::join(createPatchStorageDirectory(), arrayDataFileName);
 			saveWav(path);
 		}
@@ -250,175 +961,1794 @@ struct Array : Module {
 	void onReset() override {
 		boundaryMode = INTERP_PERIODIC;
 		enableEditing = true;
+		wavetableFrames = 1;
+		terrainRows = 1;
+		terrainBicubic = true;
+		positionMode = POSITION_INPUT;
+		antiAliasing = false;
+		convolution = false;
+		convolutionOnWorker = false;
+		updateConvolutionRenderer();
+		snapToZero = false;
+		oversampling = 1;
+		cvRate = 1;
+		blockProcessing = false;
+		governor.budget = 0.f;
+		governor.reset();
+		cacheCoefficients = false;
+		setTapeMode(false);
+		resetPlayer();
+		updatePortLabels();
+		setNumLanes(1);
 		initBuffer();
 	}
 
 	void onRandomize() override {
 		Module::onRandomize();
-		for(unsigned int i = 0; i < buffer.size(); i++) {
-			buffer[i] = random::uniform();
+		std::lock_guard<std::mutex> lock(bufferMutex);
+		for(int l = 0; l < getNewNumLanes(); l++) {
+			float *x = getNewLane(l);
+			for(unsigned int i = 0; i < buffer.size(); i++) {
+				x[i] = random::uniform();
+			}
 		}
+		markDirty(0, buffer.size());
 	}
 };
 
 const std::string Array::arrayDataFileName = "arraydata.wav";
 
-void Array::loadSample(std::string path, bool resizeBuf) {
+void Array::loadSample(std::string path, bool resizeBuf, bool loadLanes) {
 	unsigned int channels, sampleRate;
 	drwav_uint64 totalPCMFrameCount;
 	float* pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &channels, &sampleRate, &totalPCMFrameCount);
 
 	if (pSampleData != NULL) {
+		std::lock_guard<std::mutex> lock(bufferMutex);
 		unsigned long nSamplesToRead = std::min((unsigned long) totalPCMFrameCount, 999999UL);
 		unsigned long newSize = resizeBuf ? nSamplesToRead : buffer.size();
 		buffer.resize(newSize, 0);
+		resizeLanes(loadLanes ? std::min<int>(channels, MAX_POLY_CHANNELS) : getNewNumLanes());
 		unsigned long max_i = std::min(newSize, nSamplesToRead);
-		for(unsigned long i = 0; i < max_i; i++) {
-			int ii = i * channels;
-			float s = pSampleData[ii];
-			if(channels == 2) {
-				s = (s + pSampleData[ii + 1]) * 0.5f; // mix stereo channels, good idea?
+		int nLanes = getNewNumLanes();
+		if(nLanes > 1) {
+			// each channel goes to its own lane
+			for(int l = 0; l < std::min<int>(nLanes, channels); l++) {
+				float *x = getNewLane(l);
+				for(unsigned long i = 0; i < max_i; i++) {
+					x[i] = (pSampleData[i * channels + l] + 1.f) * 0.5f;
+				}
+			}
+		} else {
+			for(unsigned long i = 0; i < max_i; i++) {
+				int ii = i * channels;
+				float s = pSampleData[ii];
+				if(channels == 2) {
+					s = (s + pSampleData[ii + 1]) * 0.5f; // mix stereo channels, good idea?
+				}
+				buffer[i] = (s + 1.f) * 0.5f;
+			}
+		}
+		markDirty(0, buffer.size());
+	}
+
+	drwav_free(pSampleData);
+}
+
+void Array::saveWav(std::string path) {
+	// use drwav to save the buffer as a wav file.
+	// based on VCV Fundamental wavetable.save();
+	drwav_data_format format;
+	std::lock_guard<std::mutex> lock(bufferMutex);
+	int numLanes = getNewNumLanes();
+	format.container = drwav_container_riff;
+	format.format = DR_WAVE_FORMAT_PCM;
+	format.channels = numLanes;
+	format.sampleRate = sampleRate; // note: this doesn't really matter, because we're not using the info when reading the sample back
+	format.bitsPerSample = 16;
+
+	drwav wav;
+	if(!drwav_init_file_write(&wav, path.c_str(), &format))
+		return;
+
+	// Rescale from the range 0..1 to -1..1, and interleave the lanes
+	size_t len = buffer.size();
+	std::vector<float> buffer_rescaled(len * numLanes);
+	for(int l = 0; l < numLanes; l++) {
+		const float *x = getNewLane(l);
+		for(size_t i = 0; i < len; i++) {
+			buffer_rescaled[i * numLanes + l] = (x[i] - 0.5f) * 2.f;
+		}
+	}
+
+	int16_t* buf = new int16_t[len * numLanes];
+	drwav_f32_to_s16(buf, buffer_rescaled.data(), len * numLanes);
+	drwav_write_pcm_frames(&wav, len, buf);
+	delete[] buf;
+
+	drwav_uninit(&wav);
+}
+
+bool Array::startSpectralJob(SpectralOperation op) {
+	if(isSpectralJobBusy()) return false;
+
+	// Take a snapshot of everything the job needs, so that it only touches
+	// the module when handing over the result.
+	std::vector<float> x = buffer;
+	float zero = getZeroValue();
+	InterpBoundaryMode mode = boundaryMode;
+	float cutoff = spectralCutoff / sampleRate;
+	float sigma = smoothingWidth;
+
+	std::vector<float> amplitudes;
+	std::istringstream harmonicsStream(harmonics);
+	float a;
+	while(harmonicsStream >> a) {
+		amplitudes.push_back(a);
+	}
+
+	return spectralJob.start([this, op, x, zero, mode, cutoff, sigma, amplitudes]() {
+		int n = x.size();
+		std::vector<float> y;
+
+		if(op == SPECTRAL_SINESUM || op == SPECTRAL_COSINESUM) {
+			y = spectral::harmonicSum(amplitudes, n, op == SPECTRAL_COSINESUM);
+			// normalize to the full range, with zero in the middle
+			float peak = 0.f;
+			for(float v : y) peak = std::max(peak, std::fabs(v));
+			for(float &v : y) v = peak > 0.f ? 0.5f + 0.5f * v / peak : 0.5f;
+		} else {
+			std::vector<float> h;
+			if(op == SPECTRAL_LOWPASS) h = spectral::lowpassKernel(cutoff);
+			else if(op == SPECTRAL_HIGHPASS) h = spectral::highpassKernel(cutoff);
+			else h = spectral::gaussianKernel(sigma);
+
+			// Extend the array on both sides according to the boundary
+			// mode, and filter around the zero value so that a high-pass
+			// filter removes the DC offset correctly.
+			int pad = h.size() / 2;
+			std::vector<float> padded(n + 2 * pad);
+			for(int i = -pad; i < n + pad; i++) {
+				padded[i + pad] = x[boundaryIndex(i, n, mode)] - zero;
+			}
+			y = spectral::convolve(padded, h);
+			for(float &v : y) v = clamp(v + zero, 0.f, 1.f);
+		}
+
+		pendingBuffer = std::move(y);
+		pendingBufferReady = true;
+	});
+}
+
+void Array::process(const ProcessArgs &args) {
+	if(blockActive && processBlockSample()) {
+		return;
+	}
+
+	if(governor.start(redundantQualityTiers())) {
+		processSample(args);
+		governor.finish(args.sampleRate);
+	} else {
+		processSample(args);
+	}
+
+	if(blockProcessing && canProcessBlocks()) {
+		// Hold the current output until the first block has been read
+		for(int i = 0; i < BLOCK_MODE_SIZE; i++) {
+			blockStep[i] = outputs[STEP_OUTPUT].getVoltage();
+			blockSmooth[i] = outputs[INTERP_OUTPUT].getVoltage();
+		}
+		blockPos = 0;
+		blockActive = true;
+	}
+}
+
+// Block processing: buffer POS and output the previous block, and read the
+// next block when the buffer is full. Between blocks, go back to processing
+// one sample at a time if block processing isn't possible anymore. Returns
+// false if the sample must be processed by processSample() instead.
+bool Array::processBlockSample() {
+	// Recording starts on the sample where REC or the button goes high, which
+	// ends the block mode. The rest of the block is dropped.
+	blockRecTriggered = recTrigger.process(rescale(inputs[REC_ENABLE_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f));
+	blockRecClicked = recClickTrigger.process(params[REC_ENABLE_PARAM].getValue());
+	if(blockRecTriggered || blockRecClicked) {
+		blockActive = false;
+		return false;
+	}
+
+	blockIn[blockPos] = inputs[PHASE_INPUT].getVoltage();
+	outputs[STEP_OUTPUT].setVoltage(blockStep[blockPos]);
+	outputs[INTERP_OUTPUT].setVoltage(blockSmooth[blockPos]);
+	if(++blockPos < BLOCK_MODE_SIZE) {
+		return true;
+	}
+	blockPos = 0;
+	blockActive = blockProcessing && canProcessBlocks();
+	if(blockActive) {
+		processBlock();
+	}
+	return true;
+}
+
+// Whether the simple case of a single channel read with POS applies, where
+// none of the features that need processing on every sample are in use. Block
+// mode isn't started while REC or the button is high, see also
+// processBlockSample().
+bool Array::canProcessBlocks() {
+	return positionMode == POSITION_INPUT
+		&& inputs[PHASE_INPUT].getChannels() <= 1
+		&& numLanes == 1
+		&& !convolution
+		&& wavetableFrames == 1
+		&& terrainRows == 1
+		&& !antiAliasing
+		&& oversampling == 1
+		&& cvRate == 1
+		&& !snapToZero
+		&& !tapeMode
+		&& !isRecording
+		&& captureIndex < 0
+		&& params[REC_ENABLE_PARAM].getValue() < 0.5f
+		&& inputs[REC_ENABLE_INPUT].getVoltage() < 0.1f
+		&& !pendingBufferReady
+		&& !pendingLanesReady
+		&& !getExpander();
+}
+
+// Read a block of the array, with the samples of the block in the lanes of
+// the SIMD vectors
+void Array::processBlock() {
+	float phaseMin, phaseMax, inOutMin, inOutMax;
+	getRange(PHASE_RANGE_PARAM, phaseMin, phaseMax);
+	getRange(OUTPUT_RANGE_PARAM, inOutMin, inOutMax);
+	// Without the expander, the read window is the whole array
+	int length = buffer.size();
+	const float *x = buffer.data();
+
+	float_4 phase = 0.f;
+	for(int j = 0; j < BLOCK_MODE_SIZE; j += 4) {
+		phase = simd::clamp(simd::rescale(float_4::load(&blockIn[j]), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
+		float_4 pos = phase * length;
+		float_4 i = simd::fmin(simd::floor(pos), length - 1.f);
+		float_4 a, b, c, d;
+		for(int t = 0; t < 4; t++) {
+			int ia, ib, ic, id;
+			getInterpIndices(int(i[t]), length, ia, ib, ic, id);
+			a[t] = x[ia];
+			b[t] = x[ib];
+			c[t] = x[ic];
+			d[t] = x[id];
+		}
+		float_4 y = tabread4(a, b, c, d, pos - i);
+		simd::rescale(b, 0.f, 1.f, inOutMin, inOutMax).store(&blockStep[j]);
+		simd::rescale(y, 0.f, 1.f, inOutMin, inOutMax).store(&blockSmooth[j]);
+	}
+	// for the display
+	phases[0] = phase[3];
+}
+
+void Array::processSample(const ProcessArgs &args) {
+	sampleRate = args.sampleRate;
+
+	if(pendingBufferReady && bufferMutex.try_lock()) {
+		// Swap instead of copying, the old buffer is freed by the next job.
+		// If a worker is reading the buffer, try again on the next sample.
+		// If the array has been resized while the job was running, the
+		// result is dropped, since it doesn't match the size of the lanes.
+		bool sizeChanged = pendingBuffer.size() != buffer.size();
+		if(!sizeChanged) {
+			buffer.swap(pendingBuffer);
+		}
+		pendingBufferReady = false;
+		bufferMutex.unlock();
+		if(!sizeChanged) {
+			markDirty(0, buffer.size());
+		}
+	}
+
+	if(pendingLanesReady && bufferMutex.try_lock()) {
+		extraLanes.swap(pendingLanes);
+		numLanes = pendingNumLanes;
+		pendingLanesReady = false;
+		bufferMutex.unlock();
+	}
+	if(numLanes > 1 && extraLanes.size() != int(buffer.size())) {
+		// The buffer has been resized, and the resized lanes couldn't be
+		// swapped in yet. Only read the buffer until then.
+		numLanes = 1;
+	}
+
+	float phaseMin, phaseMax;
+	getRange(PHASE_RANGE_PARAM, phaseMin, phaseMax);
+
+	int size = buffer.size();
+
+
+	float inOutMin, inOutMax;
+	getRange(OUTPUT_RANGE_PARAM, inOutMin, inOutMax);
+
+	// recording
+	recPhase = clamp(rescale(inputs[REC_PHASE_INPUT].getVoltage(), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
+	// The edges may have been detected by processBlockSample() already
+	bool recWasTriggered = recTrigger.process(rescale(inputs[REC_ENABLE_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f)) || blockRecTriggered;
+	bool recWasClicked = recClickTrigger.process(params[REC_ENABLE_PARAM].getValue()) || blockRecClicked;
+	blockRecTriggered = false;
+	blockRecClicked = false;
+
+	if(recMode == GATE) {
+		isRecording = recTrigger.isHigh() || recClickTrigger.isHigh();
+	} else if(recMode == TOGGLE && (recWasTriggered || recWasClicked)) {
+		isRecording = !isRecording;
+	} else if(recMode == CAPTURE) {
+		if(recWasTriggered || recWasClicked) {
+			captureIndex = 0; // a new trigger restarts the capture
+		}
+		isRecording = captureIndex >= 0;
+	}
+	if(recMode != CAPTURE) {
+		captureIndex = -1;
+	}
+
+	if(tapeMode || tapeRecording) {
+		recordTape(inOutMin, inOutMax);
+	} else if(positionMode == POSITION_DELAY) {
+		writeDelay(inOutMin, inOutMax);
+	} else if(captureIndex >= 0) {
+		writeFrame(std::min(captureIndex, size - 1), inOutMin, inOutMax);
+		recPhase = captureIndex / float(size);
+	} else if(isRecording) {
+		record(phaseMin, phaseMax, inOutMin, inOutMax);
+	}
+	lights[REC_LIGHT].setBrightness(isRecording);
+
+	// Like tabwrite~ in Pd, the capture writes exactly one element per
+	// sample, and stops at the end of the array.
+	if(captureIndex >= 0 && ++captureIndex >= size) {
+		captureIndex = -1;
+		captureEndPulse.trigger(1e-3f);
+	}
+
+	ArrayExpander *expander = getExpander();
+	if(expander) {
+		bool captureEnd = captureEndPulse.process(args.sampleTime);
+		expander->outputs[ArrayExpander::EOC_OUTPUT].setVoltage(captureEnd ? 10.f : 0.f);
+	}
+
+	if(convolution) {
+		if(expander) {
+			expander->outputs[ArrayExpander::SLOPE_OUTPUT].setChannels(1);
+			expander->outputs[ArrayExpander::SLOPE_OUTPUT].setVoltage(0.f);
+		}
+		processConvolution();
+		adaaChannels = 0;
+		return;
+	}
+	nChannels = inputs[PHASE_INPUT].getChannels();
+	if(numLanes > 1) {
+		// one output channel per lane, a monophonic POS is used for all lanes
+		nChannels = numLanes;
+	}
+	if(readWindowDivider.process() || readWindowSize != size) {
+		updateReadWindow(expander);
+	}
+	if(positionMode == POSITION_OSCILLATOR) {
+		// like a VCO, output one channel even if V/Oct is not connected
+		nChannels = std::max(nChannels, 1);
+		updateOscillator(args.sampleTime, expander);
+	} else if(positionMode == POSITION_PLAYER) {
+		if(activePositionMode != POSITION_PLAYER) {
+			resetPlayer();
+		}
+		// one voice per channel of GATE, all of which can have the same pitch
+		if(expander) {
+			nChannels = std::max(nChannels, expander->inputs[ArrayExpander::GATE_INPUT].getChannels());
+		}
+		nChannels = std::max(nChannels, 1);
+		slicesActive = expander && expander->inputs[ArrayExpander::SLICE_INPUT].isConnected();
+		if(slicesActive) {
+			selectSlices(expander);
+		}
+		updatePlayer(expander);
+	} else {
+		if(positionMode == POSITION_DELAY || positionMode == POSITION_GRANULAR) {
+			nChannels = std::max(nChannels, 1);
+		}
+		updatePhasesFromInput(phaseMin, phaseMax);
+		slicesActive = expander && expander->inputs[ArrayExpander::SLICE_INPUT].isConnected();
+		if(slicesActive && positionMode == POSITION_INPUT) {
+			selectSlices(expander);
+		}
+		if(snapToZero && positionMode == POSITION_INPUT) {
+			snapJumps();
+		}
+	}
+	activePositionMode = positionMode;
+	outputs[STEP_OUTPUT].setChannels(nChannels);
+	outputs[INTERP_OUTPUT].setChannels(nChannels);
+
+	// The slope is only computed if the output is connected, and the modes
+	// that don't support it leave it at 0V.
+	Output *slopeOutput = nullptr;
+	if(expander && expander->outputs[ArrayExpander::SLOPE_OUTPUT].isConnected()) {
+		slopeOutput = &expander->outputs[ArrayExpander::SLOPE_OUTPUT];
+		slopeOutput->setChannels(nChannels);
+		for(int c = 0; c < nChannels; c++) {
+			slopeOutput->setVoltage(0.f, c);
+		}
+	}
+
+	if(expander && expander->outputs[ArrayExpander::INV_OUTPUT].isConnected()) {
+		processInverse(expander, phaseMin, phaseMax, inOutMin, inOutMax);
+	}
+
+	averageActive = expander && expander->outputs[ArrayExpander::AVG_OUTPUT].isConnected();
+	if(averageActive) {
+		processAverage(expander, inOutMin, inOutMax);
+	}
+
+	if(positionMode == POSITION_DELAY) {
+		processDelay(inOutMin, inOutMax);
+		adaaChannels = 0;
+		return;
+	}
+
+	if(positionMode == POSITION_GRANULAR) {
+		processGranular(args.sampleTime, expander, inOutMin, inOutMax);
+		adaaChannels = 0;
+		return;
+	}
+
+	if(positionMode == POSITION_PLAYER) {
+		processPlayer(inOutMin, inOutMax);
+		adaaChannels = 0;
+		return;
+	}
+
+	if(numLanes > 1) {
+		processLanes(slopeOutput, inOutMin, inOutMax);
+		adaaChannels = 0;
+		return;
+	}
+
+	if(terrainRows > 1) {
+		// Like the wavetable, fall back to reading the array directly until
+		// the grid has been built.
+		Terrain *terrain = terrainMailbox.get();
+		if(terrain && terrain->height == terrainRows && terrain->width == size / terrainRows) {
+			processTerrain(*terrain, expander, phaseMin, phaseMax, inOutMin, inOutMax);
+			adaaChannels = 0;
+			return;
+		}
+	}
+
+	if(wavetableFrames > 1) {
+		// Use the band-limited wavetable once it has been built for the
+		// current settings, otherwise fall back to reading the array directly.
+		Wavetable *wt = wavetableMailbox.get();
+		if(wt && wt->numFrames == wavetableFrames && wt->frameSize == size / wavetableFrames) {
+			processWavetable(*wt, expander, inOutMin, inOutMax);
+			adaaChannels = 0; // the wavetable is already band-limited
+			return;
+		}
+	}
+
+	if(cvRate != 1 && (positionMode == POSITION_INPUT || positionMode == POSITION_OSCILLATOR)) {
+		processControlRate(slopeOutput, inOutMin, inOutMax);
+		adaaChannels = 0;
+		return;
+	}
+	cvChannels = 0;
+
+	// The quality governor may turn off oversampling and ADAA for a while
+	int factor = governedOversampling();
+	// Until the worker has built the integral table, the output isn't
+	// anti-aliased
+	bool adaa = governedAntiAliasing() && syncIntegral();
+
+	// The cached coefficients are also used by interpolate4()
+	bool cached = syncCoefficients();
+
+	if(adaa) {
+		adaaChannels = std::min(adaaChannels, nChannels);
+		if(takeIntegralModified()) {
+			// The integral has changed, so the previous values must be
+			// recomputed to match the new table.
+			for(int chan = 0; chan < adaaChannels; chan++) {
+				adaaPrevF[chan] = integralAt(adaaPrevPos[chan]);
+			}
+		}
+		// Newly added channels start from the current position
+		for(int chan = adaaChannels; chan < nChannels; chan++) {
+			adaaPrevPos[chan] = readStart[chan] + phases[chan] * double(readLength[chan]);
+			adaaPrevF[chan] = integralAt(adaaPrevPos[chan]);
+		}
+		adaaChannels = nChannels;
+	} else {
+		adaaChannels = 0;
+	}
+
+	for(int chan = 0; chan < nChannels; chan++) {
+		float phase = phases[chan];
+		// POS covers the read window, which is the whole array by default
+		int start = readStart[chan];
+		int length = readLength[chan];
+		// direct output
+		int i_step = clamp((int) std::floor(phase * length), 0, length - 1);
+		outputs[STEP_OUTPUT].setVoltage(rescale(buffer[start + i_step], 0.f, 1.f, inOutMin, inOutMax), chan);
+
+		// With oversampling, the smooth output is handled below
+		bool smoothDone = factor > 1;
+		if(adaa && !smoothDone) {
+			float y = antiAliasedRead(chan, start + phase * double(length));
+			outputs[INTERP_OUTPUT].setVoltage(rescale(y, 0.f, 1.f, inOutMin, inOutMax), chan);
+			smoothDone = true;
+		}
+		if(smoothDone && !slopeOutput) {
+			continue;
+		}
+
+		// interpolated output, based on tabread4_tilde_perform() in
+		// https://github.com/pure-data/pure-data/blob/master/src/d_array.c
+		//TODO: adjust symmetry of surrounding indices (based on range polarity)?
+		int i = i_step;
+		float frac = phase * length - i; // fractional part of phase
+		float k[4]; // the cubic polynomial between elements i and i + 1
+		// The cached coefficients use the boundary mode at the ends of the
+		// array, so they can't be used at the ends of a smaller window.
+		if(cached && (length == size || (i >= 1 && i + 2 < length))) {
+			std::copy(&coefficients->k[4 * (start + i)], &coefficients->k[4 * (start + i) + 4], k);
+		} else {
+			int ia, ib, ic, id;
+			getInterpIndices(i, length, ia, ib, ic, id);
+			const float *x = &buffer[start];
+			k[0] = x[ib];
+			tabread4Coefficients(x[ia], x[ib], x[ic], x[id], k[1], k[2], k[3]);
+		}
+
+		if(!smoothDone) {
+			float y = k[0] + frac * (k[1] + frac * (k[2] + frac * k[3]));
+			outputs[INTERP_OUTPUT].setVoltage(rescale(y, 0.f, 1.f, inOutMin, inOutMax), chan);
+		}
+		// The slope is the derivative of the cubic, in volts per POS range
+		if(slopeOutput) {
+			float slope = k[1] + frac * (2.f * k[2] + frac * 3.f * k[3]);
+			slopeOutput->setVoltage(clamp(slope * length * (inOutMax - inOutMin), -10.f, 10.f), chan);
+		}
+	}
+
+	if(factor != activeOversampling) {
+		// clear the history of the filters that are taken into use
+		for(int i = 0; i < MAX_POLY_CHANNELS / 4; i++) {
+			upsampler2[i].reset();
+			upsampler4[i].reset();
+			upsampler8[i].reset();
+			decimator2[i].reset();
+			decimator4[i].reset();
+			decimator8[i].reset();
+		}
+		activeOversampling = factor;
+	}
+	switch(factor) {
+		case 2: processOversampled<2>(upsampler2, decimator2, adaa, inOutMin, inOutMax); break;
+		case 4: processOversampled<4>(upsampler4, decimator4, adaa, inOutMin, inOutMax); break;
+		case 8: processOversampled<8>(upsampler8, decimator8, adaa, inOutMin, inOutMax); break;
+		default: break;
+	}
+
+}
+
+// Record each channel of REC IN at the position given by the same channel of
+// REC POS, either into its own lane, or as separate write heads into the same
+// lane if there is only one. Monophonic inputs are used for all channels.
+void Array::record(float phaseMin, float phaseMax, float inOutMin, float inOutMax) {
+	int size = buffer.size();
+	int nRec = std::max(std::max(inputs[REC_SIGNAL_INPUT].getChannels(), inputs[REC_PHASE_INPUT].getChannels()), 1);
+	if(numLanes > 1) {
+		nRec = std::min(nRec, numLanes);
+	} else if(inputs[REC_PHASE_INPUT].getChannels() <= 1) {
+		// A single write head records the first channel of REC IN
+		nRec = 1;
+	}
+
+	for(int c = 0; c < nRec; c += 4) {
+		float_4 pos = simd::clamp(simd::rescale(inputs[REC_PHASE_INPUT].getPolyVoltageSimd<float_4>(c), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
+		float_4 value = simd::clamp(simd::rescale(inputs[REC_SIGNAL_INPUT].getPolyVoltageSimd<float_4>(c), inOutMin, inOutMax, 0.f, 1.f), 0.f, 1.f);
+		float_4 index = simd::fmin(simd::floor(pos * size), size - 1);
+
+		// When several heads write to the same element, the channels are
+		// written in increasing order, so the highest channel wins.
+		for(int lane = 0; lane < 4 && c + lane < nRec; lane++) {
+			int i = index[lane];
+			if(numLanes > 1) {
+				getLane(c + lane)[i] = value[lane];
+				if(c + lane == 0) markRecorded(i);
+			} else {
+				buffer[i] = value[lane];
+				markRecorded(i);
+			}
+		}
+	}
+}
+
+// Stream REC IN to disk, and write it into the array at a position that
+// advances by one element per sample, so that the display shows the most
+// recent part of the recording.
+void Array::recordTape(float inOutMin, float inOutMax) {
+	if(!tapeMode || !isRecording) {
+		if(tapeRecording) {
+			tape.stop();
+			tapeRecording = false;
+		}
+		return;
+	}
+
+	if(!tapeRecording) {
+		// The number of channels is fixed for the duration of the take
+		int channels = std::max(inputs[REC_SIGNAL_INPUT].getChannels(), 1);
+		if(!tape.start(channels, sampleRate)) {
+			// the previous take is still being written to disk
+			return;
+		}
+		tapeRecording = true;
+		tapeChannels = channels;
+	}
+
+	// Rescaled to -1..1 like in saveWav(), so that the file can be loaded
+	// back into an Array with the same range.
+	float frame[MAX_POLY_CHANNELS];
+	for(int c = 0; c < tapeChannels; c += 4) {
+		float_4 v = inputs[REC_SIGNAL_INPUT].getPolyVoltageSimd<float_4>(c);
+		simd::rescale(v, inOutMin, inOutMax, -1.f, 1.f).store(&frame[c]);
+	}
+	tape.write(frame);
+
+	int size = buffer.size();
+	tapeHead = tapeHead < size ? tapeHead : 0;
+	for(int l = 0; l < std::min(numLanes, tapeChannels); l++) {
+		getLane(l)[tapeHead] = clamp(frame[l] * 0.5f + 0.5f, 0.f, 1.f);
+	}
+	markRecorded(tapeHead);
+	tapeHead = (tapeHead + 1) % size;
+	recPhase = tapeHead / float(size);
+}
+
+// Write REC IN to element i, each channel into its own lane
+void Array::writeFrame(int i, float inOutMin, float inOutMax) {
+	for(int l = 0; l < numLanes; l++) {
+		float v = inputs[REC_SIGNAL_INPUT].getPolyVoltage(l);
+		getLane(l)[i] = clamp(rescale(v, inOutMin, inOutMax, 0.f, 1.f), 0.f, 1.f);
+	}
+	markRecorded(i);
+}
+
+// Delay mode, like delwrite~ in Pd: the write head advances by one element
+// per sample, and REC IN is written while recording is enabled. When
+// recording is off, the array keeps its contents, so it works as a looper.
+void Array::writeDelay(float inOutMin, float inOutMax) {
+	int size = buffer.size();
+	delayHead = delayHead < size ? delayHead : 0;
+	if(isRecording) {
+		writeFrame(delayHead, inOutMin, inOutMax);
+	}
+	recPhase = delayHead / float(size);
+	if(++delayHead >= size) delayHead = 0;
+}
+
+// Delay mode, like delread4~ in Pd: each channel of POS sets a delay time
+// relative to the last written element, where the POS range covers the whole
+// length of the array.
+void Array::processDelay(float inOutMin, float inOutMax) {
+	int size = buffer.size();
+	if(size < 4) {
+		// Too short for the 4-point interpolation, output 0V
+		float zero = rescale(getZeroValue(), 0.f, 1.f, inOutMin, inOutMax);
+		for(int c = 0; c < nChannels; c++) {
+			outputs[STEP_OUTPUT].setVoltage(zero, c);
+			outputs[INTERP_OUTPUT].setVoltage(zero, c);
+		}
+		return;
+	}
+	// The 4-point interpolation reads one element after the read position,
+	// so it must stay two elements behind the write head.
+	float minDelay = 2.f;
+	float maxDelay = size - 2.f;
+	int newest = delayHead > 0 ? delayHead - 1 : size - 1;
+
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 delay = simd::clamp(float_4::load(&phases[c]) * size, minDelay, maxDelay);
+		// The read position newest - delay is split into an integer index
+		// and a fraction, which would lose precision in a single float in
+		// long arrays. The indices are exact in float up to 2^24.
+		float_4 delayInt = simd::floor(delay);
+		float_4 delayFrac = delay - delayInt;
+		float_4 carry = simd::ifelse(delayFrac > 0.f, 1.f, 0.f);
+		float_4 i = newest - delayInt - carry;
+		float_4 frac = carry - delayFrac;
+		// Wrap around with comparisons instead of modulo, the read position
+		// is never more than one array length behind.
+		i += simd::ifelse(i < 0.f, float_4(size), 0.f);
+		float_4 ia = i - 1.f;
+		float_4 ic = i + 1.f;
+		float_4 id = i + 2.f;
+		ia += simd::ifelse(ia < 0.f, float_4(size), 0.f);
+		ic -= simd::ifelse(ic >= size, float_4(size), 0.f);
+		id -= simd::ifelse(id >= size, float_4(size), 0.f);
+
+		float_4 a, b, cc, d;
+		for(int lane = 0; lane < 4; lane++) {
+			// with several lanes, each channel reads its own lane
+			const float *x = getLane(std::min(c + lane, numLanes - 1));
+			a[lane] = x[int(ia[lane])];
+			b[lane] = x[int(i[lane])];
+			cc[lane] = x[int(ic[lane])];
+			d[lane] = x[int(id[lane])];
+		}
+		float_4 y = tabread4(a, b, cc, d, frac);
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(b, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(y, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
+}
+
+// Granular mode: each voice starts grains at the position given by its channel
+// of POS, at a rate set by DENSITY, and each grain plays the array at the
+// original speed under a Hann window whose length is set by SIZE. The grains
+// of a voice are processed four at a time.
+void Array::processGranular(float sampleTime, ArrayExpander *expander, float inOutMin, float inOutMax) {
+	int size = buffer.size();
+	float zero = getZeroValue();
+	if(size != grainArraySize) {
+		// The grains may be past the end of the resized array
+		for(int c = 0; c < MAX_POLY_CHANNELS; c++) {
+			grainVoices[c].reset();
+		}
+		grainArraySize = size;
+	}
+
+	for(int c = 0; c < nChannels; c++) {
+		// Without the expander, 20 grains per second of 100 ms each. Both
+		// inputs are 1V/octave, 0V is one grain per second and 1 ms
+		// respectively.
+		float density = 20.f;
+		float duration = 0.1f;
+		if(expander) {
+			Input &densityInput = expander->inputs[ArrayExpander::DENSITY_INPUT];
+			Input &sizeInput = expander->inputs[ArrayExpander::SIZE_INPUT];
+			if(densityInput.isConnected()) {
+				density = dsp::approxExp2_taylor5(clamp(densityInput.getPolyVoltage(c), 0.f, 10.f));
+			}
+			if(sizeInput.isConnected()) {
+				duration = 1e-3f * dsp::approxExp2_taylor5(clamp(sizeInput.getPolyVoltage(c), 0.f, 10.f));
+			}
+		}
+
+		GrainVoice &voice = grainVoices[c];
+		if(voice.tick(density, sampleTime)) {
+			voice.start(std::min(phases[c] * size, size - 1.f), 1.f / std::max(duration / sampleTime, 1.f));
+		}
+
+		// with several lanes, each voice reads its own lane
+		const float *x = getLane(std::min(c, numLanes - 1));
+		float_4 sumStep = 0.f;
+		float_4 sumInterp = 0.f;
+		for(int g = 0; g < voice.numActive; g += 4) {
+			// The slots beyond numActive have a zero window
+			float_4 w = grainWindow.read(float_4::load(&voice.windowPhases[g]));
+			float_4 pos = float_4::load(&voice.positions[g]);
+			float_4 i = simd::floor(pos);
+			float_4 a, b, cc, d;
+			for(int lane = 0; lane < 4; lane++) {
+				int ia, ib, ic, id;
+				getInterpIndices(int(i[lane]), size, ia, ib, ic, id);
+				a[lane] = x[ia];
+				b[lane] = x[ib];
+				cc[lane] = x[ic];
+				d[lane] = x[id];
+			}
+			float_4 y = tabread4(a, b, cc, d, pos - i);
+			sumStep += w * (b - zero);
+			sumInterp += w * (y - zero);
+		}
+		voice.advance(size);
+
+		// Scale by the average number of overlapping grains, the mean of the
+		// Hann window is 0.5.
+		float gain = 1.f / std::max(0.5f * density * duration, 1.f);
+		float step = zero + gain * (sumStep[0] + sumStep[1] + sumStep[2] + sumStep[3]);
+		float interp = zero + gain * (sumInterp[0] + sumInterp[1] + sumInterp[2] + sumInterp[3]);
+		outputs[STEP_OUTPUT].setVoltage(rescale(step, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltage(rescale(interp, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
+}
+
+// Sample player mode: each playing voice reads its read window at the position
+// set by updatePlayer(), the stopped voices output the zero value of the
+// range.
+void Array::processPlayer(float inOutMin, float inOutMax) {
+	float zero = getZeroValue();
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 index = float_4::load(&playerIndices[c]);
+		float_4 frac = float_4::load(&playerFracs[c]);
+		float_4 active = float_4::load(&playerActive[c]) > 0.f;
+		float_4 a, b, cc, d;
+		for(int lane = 0; lane < 4; lane++) {
+			// with several lanes, each voice reads its own lane
+			const float *x = getLane(std::min(c + lane, numLanes - 1)) + readStart[c + lane];
+			int length = readLength[c + lane];
+			int ia, ib, ic, id;
+			// the stopped voices can be past the end of the window
+			getInterpIndices(std::min(int(index[lane]), length - 1), length, ia, ib, ic, id);
+			a[lane] = x[ia];
+			b[lane] = x[ib];
+			cc[lane] = x[ic];
+			d[lane] = x[id];
+		}
+		float_4 y = tabread4(a, b, cc, d, frac);
+		b = simd::ifelse(active, b, zero);
+		y = simd::ifelse(active, y, zero);
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(b, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(y, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
+}
+
+// The average of the interpolated array over a window of the given width (in
+// elements) around center, from the difference of the integral at the ends of
+// the window. In periodic mode the window wraps around the ends of the array,
+// otherwise it's cut at the ends.
+float Array::windowAverage(double center, double width) {
+	int size = buffer.size();
+	double lo = center - 0.5 * width;
+	double hi = center + 0.5 * width;
+	double Flo, Fhi;
+	if(boundaryMode == INTERP_PERIODIC) {
+		double total = integral->sums.get(size);
+		double kLo = std::floor(lo / size);
+		double kHi = std::floor(hi / size);
+		Flo = integralAt(lo - kLo * size) + kLo * total;
+		Fhi = integralAt(hi - kHi * size) + kHi * total;
+	} else {
+		lo = std::max(lo, 0.0);
+		hi = std::min(hi, double(size));
+		Flo = integralAt(lo);
+		Fhi = integralAt(hi);
+	}
+	// For very narrow windows the difference is inaccurate, but the average
+	// is close to the value at the center.
+	if(hi - lo < 1e-3) {
+		return interpolateAt(clamp(center, 0.0, double(size)));
+	}
+	return (Fhi - Flo) / (hi - lo);
+}
+
+// Windowed average output: the average of the array around each channel of
+// POS, where the WIDTH input sets the width of the window from 0 to the whole
+// array. This is only meaningful when POS is a position, in the other modes
+// the output is 0V.
+void Array::processAverage(ArrayExpander *expander, float inOutMin, float inOutMax) {
+	Output &avgOutput = expander->outputs[ArrayExpander::AVG_OUTPUT];
+	avgOutput.setChannels(nChannels);
+	if(positionMode != POSITION_INPUT && positionMode != POSITION_OSCILLATOR) {
+		for(int c = 0; c < nChannels; c++) {
+			avgOutput.setVoltage(0.f, c);
+		}
+		return;
+	}
+
+	// Until the worker has built the integral table, output the value at POS
+	bool ready = syncIntegral();
+	int size = buffer.size();
+	Input &widthInput = expander->inputs[ArrayExpander::WIDTH_INPUT];
+	for(int c = 0; c < nChannels; c++) {
+		double width = clamp(widthInput.getPolyVoltage(c) * 0.1f, 0.f, 1.f) * double(size);
+		float y = ready ? windowAverage(phases[c] * double(size), width) : interpolateAt(phases[c] * double(size));
+		avgOutput.setVoltage(rescale(y, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
+}
+
+// Update the read windows from the START and LENGTH inputs. START selects the
+// start of the window in the whole array (0..10V), LENGTH the length of the
+// window as a fraction of the whole array (0..10V), by default up to the end.
+// The window is at least 4 elements long, so that the 4-point interpolation
+// works with all boundary modes.
+void Array::updateReadWindow(ArrayExpander *expander) {
+	int size = buffer.size();
+	readWindowSize = size;
+	Input *startInput = expander ? &expander->inputs[ArrayExpander::START_INPUT] : nullptr;
+	Input *lengthInput = expander ? &expander->inputs[ArrayExpander::LENGTH_INPUT] : nullptr;
+	bool startConnected = startInput && startInput->isConnected();
+	bool lengthConnected = lengthInput && lengthInput->isConnected();
+	const ZeroCrossings *zc = snapToZero ? zeroCrossingsMailbox.get() : nullptr;
+
+	// All channels are updated, since the number of channels can change
+	// before the next update
+	for(int c = 0; c < MAX_POLY_CHANNELS; c++) {
+		int start = 0;
+		int length = size;
+		if(size > 4 && (startConnected || lengthConnected)) {
+			if(startConnected) {
+				start = int(clamp(startInput->getPolyVoltage(c) * 0.1f, 0.f, 1.f) * size);
+				if(zc && zc->size == size) {
+					start = std::max(zc->nearest(start), 0);
+				}
+				start = std::min(start, size - 4);
+			}
+			length = size - start;
+			if(lengthConnected) {
+				length = clamp(int(clamp(lengthInput->getPolyVoltage(c) * 0.1f, 0.f, 1.f) * size), 4, length);
+			}
+		}
+		readStart[c] = start;
+		readLength[c] = length;
+	}
+}
+
+// Set the read window of each channel to the slice selected by the SLICE
+// input, so that the POS range covers the slice instead of the whole array.
+// This overrides the START and LENGTH inputs. The slices are only looked up
+// here, the onsets are detected by the worker thread.
+void Array::selectSlices(ArrayExpander *expander) {
+	int size = buffer.size();
+	const Slices *slices = slicesMailbox.get();
+	if(!slices || slices->size != size) return;
+	Input &sliceInput = expander->inputs[ArrayExpander::SLICE_INPUT];
+	int n = slices->numSlices();
+	for(int c = 0; c < nChannels; c++) {
+		int slice = clamp(int(sliceInput.getPolyVoltage(c) * 0.1f * n), 0, n - 1);
+		readStart[c] = slices->start(slice);
+		readLength[c] = slices->end(slice) - readStart[c];
+	}
+}
+
+// When POS jumps, move the playback position to the nearest zero crossing,
+// and keep playing from there with the same offset from POS until the next
+// jump. A jump is a change of more than SNAP_JUMP_RATIO times the recent
+// speed of POS (snapSpeeds), and of at least SNAP_MIN_JUMP elements, such as
+// the jump of a sawtooth wave at the end of a loop.
+void Array::snapJumps() {
+	int size = buffer.size();
+	const ZeroCrossings *zc = zeroCrossingsMailbox.get();
+	if(!zc || zc->size != size) return;
+	for(int c = 0; c < nChannels; c++) {
+		int start = readStart[c];
+		int length = readLength[c];
+		float pos = start + phases[c] * length;
+		float step = std::fabs(pos - snapPrevPos[c]);
+		float threshold = SNAP_JUMP_RATIO * snapSpeeds[c];
+		threshold = threshold > SNAP_MIN_JUMP ? threshold : SNAP_MIN_JUMP;
+		if(step > threshold) {
+			int z = zc->nearest(pos);
+			snapOffsets[c] = z >= 0 ? z - pos : 0.f;
+			// A single jump only raises the speed a little, but if POS keeps
+			// moving this fast, it soon stops counting as jumps.
+			step = threshold;
+		}
+		// average over about 64 samples
+		snapSpeeds[c] += (step - snapSpeeds[c]) * (1.f / 64.f);
+		snapPrevPos[c] = pos;
+		phases[c] = clamp((pos + snapOffsets[c] - start) / length, 0.f, 1.f);
+	}
+}
+
+// Inverse lookup for monotonic arrays, e.g. after sorting: the position where
+// the array crosses the VALUE input, interpolated linearly between elements.
+// The binary search takes the same number of steps for every channel, so that
+// four channels are searched at a time, selecting the next half without
+// branches. It reads the buffer directly, so there's no table to update.
+void Array::processInverse(ArrayExpander *expander, float phaseMin, float phaseMax, float inOutMin, float inOutMax) {
+	Input &valueInput = expander->inputs[ArrayExpander::VALUE_INPUT];
+	Output &invOutput = expander->outputs[ArrayExpander::INV_OUTPUT];
+	int size = buffer.size();
+	const float *x = buffer.data();
+	int nc = std::max(valueInput.getChannels(), 1);
+	invOutput.setChannels(nc);
+
+	// Descending arrays are searched with the values negated
+	float dir = x[size - 1] < x[0] ? -1.f : 1.f;
+	for(int c = 0; c < nc; c += 4) {
+		float_4 v = dir * simd::rescale(valueInput.getPolyVoltageSimd<float_4>(c), inOutMin, inOutMax, 0.f, 1.f);
+
+		// The last element that is <= v (or the first element) is in
+		// [base, base + n).
+		float_4 base = 0.f;
+		for(int n = size; n > 1; ) {
+			int half = n / 2;
+			float_4 probe;
+			for(int lane = 0; lane < 4; lane++) {
+				probe[lane] = x[int(base[lane]) + half];
+			}
+			base += simd::ifelse(dir * probe <= v, float_4(half), 0.f);
+			n -= half;
+		}
+
+		float_4 lo, hi;
+		for(int lane = 0; lane < 4; lane++) {
+			int i = int(base[lane]);
+			lo[lane] = x[i];
+			hi[lane] = x[std::min(i + 1, size - 1)];
+		}
+		lo *= dir;
+		hi *= dir;
+		float_4 frac = simd::ifelse(hi > lo, (v - lo) / (hi - lo), 0.f);
+		float_4 pos = (base + simd::clamp(frac, 0.f, 1.f)) / size;
+		invOutput.setVoltageSimd(simd::rescale(pos, 0.f, 1.f, phaseMin, phaseMax), c);
+	}
+}
+
+// Convolution mode: the first channel of REC IN is convolved with the array.
+// OUT SMTH is the convolved signal, OUT STEP is the input delayed by the same
+// latency, for mixing the dry and wet signals.
+void Array::processConvolution() {
+	float in = inputs[REC_SIGNAL_INPUT].getVoltage();
+	float out[2]; // wet, dry
+	if(!convolutionRenderer.process(convolutionOnWorker, &in, out)) {
+		out[0] = convolver.process(in, convolutionMailbox.get(), out[1]);
+	}
+	outputs[STEP_OUTPUT].setChannels(1);
+	outputs[INTERP_OUTPUT].setChannels(1);
+	outputs[STEP_OUTPUT].setVoltage(out[1]);
+	outputs[INTERP_OUTPUT].setVoltage(out[0]);
+}
+
+// Like markDirty(i, i + 1), but the tables that are maintained on the engine
+// thread are updated right away. Otherwise the dirty range would grow to
+// cover most of the array when recording with several write heads.
+void Array::markRecorded(int i) {
+	wavetableDirty.mark(i, i + 1);
+	convolutionDirty.mark(i, i + 1);
+	terrainDirty.mark(i, i + 1);
+	zeroCrossingsDirty.mark(i, i + 1);
+	slicesDirty.mark(i, i + 1);
+	int size = buffer.size();
+	integralWorkerDirty.mark(i, i + 1);
+	if((antiAliasing || averageActive) && integral && integral->sums.size() == size && integral->boundaryMode == boundaryMode) {
+		updateIntegralRange(i, i + 1);
+	} else {
+		integralDirty.mark(i, i + 1);
+	}
+	coefficientsWorkerDirty.mark(i, i + 1);
+	if(cacheCoefficients && coefficients && int(coefficients->k.size()) == 4 * size && coefficients->boundaryMode == boundaryMode) {
+		updateCoefficientsRange(i, i + 1);
+	} else {
+		coefficientsDirty.mark(i, i + 1);
+	}
+}
+
+// Bring the integral table up to date with the buffer. Returns false if
+// there is no table for the current size and settings yet, in which case it
+// is requested from the worker. The engine thread never allocates the table.
+bool Array::syncIntegral() {
+	int size = buffer.size();
+	size_t lo, hi;
+	IntegralTable *table = integralMailbox.get();
+	if(table != integral) {
+		// The new table is missing the changes made after the worker started
+		// building it, the earlier ones are included.
+		integral = table;
+		integralPending = false;
+		integralDirty.take(lo, hi);
+		if(integralWorkerDirty.take(lo, hi)) integralDirty.mark(lo, hi);
+		integralModified = true;
+	}
+	if(!integral || integral->sums.size() != size || integral->boundaryMode != boundaryMode) {
+		integralDirty.take(lo, hi);
+		requestIntegral();
+		return false;
+	}
+	if(integralDirty.take(lo, hi)) {
+		lo = std::min<size_t>(lo, size);
+		hi = std::min<size_t>(hi, size);
+		if(hi - lo > MAX_INCREMENTAL_UPDATE) {
+			// The old table is used until the new one is ready
+			requestIntegral();
+		} else {
+			updateIntegralRange(lo, hi);
+		}
+	}
+	return true;
+}
+
+void Array::requestIntegral() {
+	if(!integralPending) {
+		integralPending = true;
+		integralRequested = true;
+	}
+}
+
+// Returns whether the integral table was changed since the last call, for
+// antiderivative anti-aliasing.
+bool Array::takeIntegralModified() {
+	bool changed = integralModified;
+	integralModified = false;
+	return changed;
+}
+
+// Integral of the segment between elements i and i + 1 of the array x
+static float segmentIntegral(const float *x, int i, int size, Array::InterpBoundaryMode mode) {
+	int ia, ib, ic, id;
+	Array::getInterpIndices(i, size, mode, ia, ib, ic, id);
+	return tabread4Integral(x[ia], x[ib], x[ic], x[id], 1.f);
+}
+
+// Update the integral after the elements [lo, hi) have been modified
+void Array::updateIntegralRange(int lo, int hi) {
+	int size = buffer.size();
+	const float *x = buffer.data();
+	InterpBoundaryMode mode = integral->boundaryMode;
+	auto valueAt = [x, size, mode](int i) {
+		return segmentIntegral(x, i, size, mode);
+	};
+	// The segment between elements i and i + 1 depends on the elements
+	// i - 1 ... i + 2, and at the boundaries also on the other end of the array.
+	PrefixSum &sums = integral->sums;
+	sums.update(lo - 2, hi + 1, valueAt);
+	if(lo < 2) sums.update(size - 2, size, valueAt);
+	if(hi > size - 2) sums.update(0, 2, valueAt);
+	integralModified = true;
+}
+
+void Array::updateSegment(int i) {
+	int size = buffer.size();
+	int ia, ib, ic, id;
+	getInterpIndices(i, size, ia, ib, ic, id);
+	float *k = &coefficients->k[4 * i];
+	k[0] = buffer[ib];
+	tabread4Coefficients(buffer[ia], buffer[ib], buffer[ic], buffer[id], k[1], k[2], k[3]);
+}
+
+// Bring the coefficient table up to date with the buffer, like
+// syncIntegral(). Returns whether the table can be used.
+bool Array::syncCoefficients() {
+	int size = buffer.size();
+	size_t lo, hi;
+	CoefficientTable *table = coefficientsMailbox.get();
+	if(table != coefficients) {
+		coefficients = table;
+		coefficientsPending = false;
+		coefficientsDirty.take(lo, hi);
+		if(coefficientsWorkerDirty.take(lo, hi)) coefficientsDirty.mark(lo, hi);
+	}
+	coefficientsReady = false;
+	if(!cacheCoefficients) {
+		return false;
+	}
+	if(!coefficients || int(coefficients->k.size()) != 4 * size || coefficients->boundaryMode != boundaryMode) {
+		coefficientsDirty.take(lo, hi);
+		requestCoefficients();
+		return false;
+	}
+	if(coefficientsDirty.take(lo, hi)) {
+		lo = std::min<size_t>(lo, size);
+		hi = std::min<size_t>(hi, size);
+		if(hi - lo > MAX_INCREMENTAL_UPDATE) {
+			requestCoefficients();
+		} else {
+			updateCoefficientsRange(lo, hi);
+		}
+	}
+	coefficientsReady = true;
+	return true;
+}
+
+void Array::requestCoefficients() {
+	if(!coefficientsPending) {
+		coefficientsPending = true;
+		coefficientsRequested = true;
+	}
+}
+
+// Update the coefficients after the elements [lo, hi) have been modified
+void Array::updateCoefficientsRange(int lo, int hi) {
+	int size = buffer.size();
+	for(int i = std::max(lo - 2, 0); i < std::min(hi + 1, size); i++) {
+		updateSegment(i);
+	}
+	for(int i = std::max(size - 2, 0); lo < 2 && i < size; i++) {
+		updateSegment(i);
+	}
+	for(int i = 0; hi > size - 2 && i < std::min(2, size); i++) {
+		updateSegment(i);
+	}
+}
+
+// Integral of the interpolated array from the start to pos, which is given
+// in elements.
+double Array::integralAt(double pos) {
+	int size = buffer.size();
+	pos = clamp(pos, 0.0, double(size));
+	int i = std::min(int(pos), size - 1);
+	int ia, ib, ic, id;
+	getInterpIndices(i, size, ia, ib, ic, id);
+	return integral->sums.get(i) + tabread4Integral<double>(buffer[ia], buffer[ib], buffer[ic], buffer[id], pos - i);
+}
+
+float Array::interpolateAt(double pos) {
+	int size = buffer.size();
+	pos = clamp(pos, 0.0, double(size));
+	int i = std::min(int(pos), size - 1);
+	int ia, ib, ic, id;
+	getInterpIndices(i, size, ia, ib, ic, id);
+	return tabread4(buffer[ia], buffer[ib], buffer[ic], buffer[id], float(pos - i));
+}
+
+// First-order antiderivative anti-aliasing: instead of the value at the
+// current position, output the average of the interpolated array between the
+// previous and the current position, (F(x1) - F(x0)) / (x1 - x0). The integral
+// table covers the whole array, so at the ends of a smaller read window the
+// curve continues into the rest of the array, regardless of the boundary mode.
+float Array::antiAliasedRead(int chan, double pos) {
+	int start = readStart[chan];
+	int length = readLength[chan];
+	double F = integralAt(pos);
+	double dPos = pos - adaaPrevPos[chan];
+	double dF = F - adaaPrevF[chan];
+	adaaPrevPos[chan] = pos;
+	adaaPrevF[chan] = F;
+
+	if(boundaryMode == INTERP_PERIODIC) {
+		// Go around the shorter way, e.g. when the phase wraps around the
+		// read window
+		if(dPos > 0.5 * length) {
+			dPos -= length;
+			dF -= integral->sums.get(start + length) - integral->sums.get(start);
+		} else if(dPos < -0.5 * length) {
+			dPos += length;
+			dF += integral->sums.get(start + length) - integral->sums.get(start);
+		}
+	}
+
+	if(std::fabs(dPos) < 1e-3) {
+		// The difference is inaccurate for small steps, but then the average
+		// is close to the value at the midpoint.
+		double mid = pos - 0.5 * dPos;
+		if(mid < start) mid += length;
+		return interpolateAt(mid);
+	}
+	return dF / dPos;
+}
+
+// The following functions process four channels at a time. The extra
+// channels beyond nChannels are harmless, since ports and the per-channel
+// arrays always have MAX_POLY_CHANNELS elements.
+
+void Array::updatePhasesFromInput(float phaseMin, float phaseMax) {
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 phase = simd::clamp(simd::rescale(inputs[PHASE_INPUT].getPolyVoltageSimd<float_4>(c), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
+		phase.store(&phases[c]);
+
+		// Estimate the playback frequency from the change in phase, taking
+		// into account the jump of a sawtooth wave.
+		float_4 delta = simd::fabs(phase - float_4::load(&prevPhases[c]));
+		delta = simd::ifelse(delta > 0.5f, 1.f - delta, delta);
+		delta.store(&phaseDeltas[c]);
+		phase.store(&prevPhases[c]);
+	}
+}
+
+void Array::updateOscillator(float sampleTime, ArrayExpander *expander) {
+	for(int c = 0; c < nChannels; c += 4) {
+		// Same as in the VCV Fundamental VCO, approxExp2_taylor5 is more
+		// accurate with positive arguments.
+		float_4 pitch = inputs[PHASE_INPUT].getPolyVoltageSimd<float_4>(c);
+		float_4 freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch + 30.f) / 1073741824.f;
+		if(expander) {
+			// linear through-zero FM, 5V deviates by the base frequency
+			freq *= 1.f + 0.2f * expander->inputs[ArrayExpander::FM_INPUT].getPolyVoltageSimd<float_4>(c);
+		}
+		float_4 delta = simd::clamp(freq * sampleTime, -0.5f, 0.5f);
+		simd::fabs(delta).store(&phaseDeltas[c]);
+
+		for(int i = 0; i < 4; i++) {
+			prevPhases[c + i] = oscPhases[c + i];
+			double phase = oscPhases[c + i] + delta[i];
+			phase -= std::floor(phase);
+			oscPhases[c + i] = phase;
+			phases[c + i] = phase;
+		}
+	}
+}
+
+// Sample player mode: advance the playing voices, and start the voices whose
+// gate has gone high. The gate crosses the threshold somewhere between the
+// previous sample and this one, so a new voice starts from the position it
+// would have reached by now, estimated by linear interpolation of the gate.
+// This keeps the timing of retriggered samples independent of the sample
+// rate. A voice stops at the end of its read window.
+void Array::updatePlayer(ArrayExpander *expander) {
+	Input *gateInput = expander ? &expander->inputs[ArrayExpander::GATE_INPUT] : nullptr;
+	for(int c = 0; c < nChannels; c += 4) {
+		// 0V plays one element per sample
+		float_4 pitch = simd::clamp(inputs[PHASE_INPUT].getPolyVoltageSimd<float_4>(c), -10.f, 10.f);
+		float_4 rate = dsp::approxExp2_taylor5(pitch + 30.f) / 1073741824.f;
+		float_4 length = float_4(readLength[c], readLength[c + 1], readLength[c + 2], readLength[c + 3]);
+
+		// The stopped voices don't move, so that the position can't grow
+		// without bounds
+		float_4 active = float_4::load(&playerActive[c]);
+		float_4 index = float_4::load(&playerIndices[c]);
+		float_4 frac = float_4::load(&playerFracs[c]) + rate * active;
+		float_4 carry = simd::floor(frac);
+		index += carry;
+		frac -= carry;
+
+		if(gateInput) {
+			float_4 gate = gateInput->getPolyVoltageSimd<float_4>(c);
+			float_4 prevGate = float_4::load(&playerPrevGates[c]);
+			gate.store(&playerPrevGates[c]);
+			float_4 trigger = playerTriggers[c / 4].process(gate, 0.1f, 1.f);
+			// The fraction of a sample since the gate crossed 1V. In the
+			// lanes that didn't trigger the result is unused.
+			float_4 elapsed = 1.f - simd::clamp((1.f - prevGate) / (gate - prevGate), 0.f, 1.f);
+			index = simd::ifelse(trigger, 0.f, index);
+			frac = simd::ifelse(trigger, elapsed * rate, frac);
+			active = simd::ifelse(trigger, 1.f, active);
+		}
+		active = simd::ifelse(index < length, active, 0.f);
+		// the window can also become shorter while the voice is playing
+		index = simd::fmin(index, length);
+
+		index.store(&playerIndices[c]);
+		frac.store(&playerFracs[c]);
+		active.store(&playerActive[c]);
+		// for the display and the other outputs
+		float_4 phase = simd::ifelse(active > 0.f, (index + frac) / length, 0.f);
+		phase.store(&phases[c]);
+		phase.store(&prevPhases[c]);
+		(rate / length).store(&phaseDeltas[c]);
+	}
+}
+
+// Read each lane at the position of the corresponding channel. The four taps
+// are gathered from four lanes at a time, and interpolated in parallel.
+void Array::processLanes(Output *slopeOutput, float inOutMin, float inOutMax) {
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 length = float_4(readLength[c], readLength[c + 1], readLength[c + 2], readLength[c + 3]);
+		float_4 pos = float_4::load(&phases[c]) * length;
+		float_4 i = simd::fmin(simd::floor(pos), length - 1.f);
+		float_4 a, b, cc, d;
+		for(int lane = 0; lane < 4; lane++) {
+			// the unused lanes of the last group read the last lane
+			const float *x = getLane(std::min(c + lane, numLanes - 1)) + readStart[c + lane];
+			int ia, ib, ic, id;
+			getInterpIndices(int(i[lane]), readLength[c + lane], ia, ib, ic, id);
+			a[lane] = x[ia];
+			b[lane] = x[ib];
+			cc[lane] = x[ic];
+			d[lane] = x[id];
+		}
+		float_4 y = tabread4(a, b, cc, d, pos - i);
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(b, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(y, 0.f, 1.f, inOutMin, inOutMax), c);
+		if(slopeOutput) {
+			float_4 slope = tabread4Slope(a, b, cc, d, pos - i) * length * (inOutMax - inOutMin);
+			slopeOutput->setVoltageSimd(simd::clamp(slope, -10.f, 10.f), c);
+		}
+	}
+}
+
+// Interpolated value of the array at four positions in the range 0..1 of the
+// read windows of channels c..c+3
+float_4 Array::interpolate4(float_4 phase, int c) {
+	int size = buffer.size();
+	float_4 length = float_4(readLength[c], readLength[c + 1], readLength[c + 2], readLength[c + 3]);
+	float_4 pos = simd::clamp(phase, 0.f, 1.f) * length;
+	float_4 i = simd::fmin(simd::floor(pos), length - 1.f);
+	float_4 frac = pos - i;
+	// Each lane either gathers its cached coefficients, or the four elements
+	// around it, see process() for when the cached coefficients can be used.
+	float_4 a = 0.f, b = 0.f, cc = 0.f, d = 0.f;
+	float_4 k0 = 0.f, k1 = 0.f, k2 = 0.f, k3 = 0.f;
+	float_4 cached = 0.f;
+	for(int lane = 0; lane < 4; lane++) {
+		int start = readStart[c + lane];
+		int n = readLength[c + lane];
+		int j = int(i[lane]);
+		if(coefficientsReady && (n == size || (j >= 1 && j + 2 < n))) {
+			const float *k = &coefficients->k[4 * (start + j)];
+			k0[lane] = k[0];
+			k1[lane] = k[1];
+			k2[lane] = k[2];
+			k3[lane] = k[3];
+			cached[lane] = 1.f;
+		} else {
+			int ia, ib, ic, id;
+			getInterpIndices(j, n, ia, ib, ic, id);
+			const float *x = &buffer[start];
+			a[lane] = x[ia];
+			b[lane] = x[ib];
+			cc[lane] = x[ic];
+			d[lane] = x[id];
+		}
+	}
+	float_4 y = tabread4(a, b, cc, d, frac);
+	if(coefficientsReady) {
+		float_4 yCached = k0 + frac * (k1 + frac * (k2 + frac * k3));
+		y = simd::ifelse(cached > 0.f, yCached, y);
+	}
+	return y;
+}
+
+// Compute the interpolated output at FACTOR times the sample rate, and filter
+// and downsample it back to the sample rate.
+template <int FACTOR>
+void Array::processOversampled(oversampling::Upsampler<FACTOR> *upsamplers, oversampling::Decimator<FACTOR> *decimators, bool adaa, float inOutMin, float inOutMax) {
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 phase[FACTOR];
+		float_4 current = float_4::load(&phases[c]);
+		if(positionMode == POSITION_OSCILLATOR) {
+			// The phase is a sawtooth, so interpolate it linearly instead of
+			// filtering, to keep the jumps sharp.
+			float_4 prev = float_4::load(&prevPhases[c]);
+			float_4 delta = current - prev;
+			delta -= simd::round(delta);
+			for(int j = 0; j < FACTOR; j++) {
+				phase[j] = prev + delta * ((j + 1.f) / FACTOR);
+				phase[j] -= simd::floor(phase[j]);
+			}
+		} else {
+			upsamplers[c / 4].process(current, phase);
+		}
+
+		float_4 y[FACTOR];
+		for(int j = 0; j < FACTOR; j++) {
+			if(adaa) {
+				for(int lane = 0; lane < 4; lane++) {
+					double pos = readStart[c + lane] + clamp(phase[j][lane], 0.f, 1.f) * double(readLength[c + lane]);
+					y[j][lane] = antiAliasedRead(c + lane, pos);
+				}
+			} else {
+				y[j] = interpolate4(phase[j], c);
+			}
+		}
+		float_4 out = decimators[c / 4].process(y);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(out, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
+}
+
+// CV rate mode: read the array every few samples, and ramp the smooth output
+// linearly from the current value to the new one in between. The direct
+// output and the slope are held. The adaptive interval is the time it takes
+// the fastest channel to move by one element, so that audio-rate POS is still
+// read on every sample.
+void Array::processControlRate(Output *slopeOutput, float inOutMin, float inOutMax) {
+	if(cvCounter > 0 && cvChannels >= nChannels) {
+		cvCounter--;
+	} else {
+		int interval = cvRate;
+		if(cvRate == CV_RATE_ADAPTIVE) {
+			float speed = 0.f; // elements per sample
+			for(int c = 0; c < nChannels; c++) {
+				speed = std::max(speed, phaseDeltas[c] * readLength[c]);
 			}
-			buffer[i] = (s + 1.f) * 0.5f;
+			interval = speed > 0.f ? clamp(int(1.f / speed), 1, CV_RATE_MAX_INTERVAL) : CV_RATE_MAX_INTERVAL;
 		}
+		cvCounter = interval - 1;
+
+		for(int c = 0; c < nChannels; c += 4) {
+			float_4 length = float_4(readLength[c], readLength[c + 1], readLength[c + 2], readLength[c + 3]);
+			float_4 pos = float_4::load(&phases[c]) * length;
+			float_4 i = simd::fmin(simd::floor(pos), length - 1.f);
+			float_4 a, b, cc, d;
+			for(int lane = 0; lane < 4; lane++) {
+				const float *x = &buffer[readStart[c + lane]];
+				int ia, ib, ic, id;
+				getInterpIndices(int(i[lane]), readLength[c + lane], ia, ib, ic, id);
+				a[lane] = x[ia];
+				b[lane] = x[ib];
+				cc[lane] = x[ic];
+				d[lane] = x[id];
+			}
+			float_4 y = tabread4(a, b, cc, d, pos - i);
+			float_4 value = float_4::load(&cvValues[c]);
+			// new channels start from the current value
+			float_4 isNew = float_4(c, c + 1, c + 2, c + 3) >= float(cvChannels);
+			value = simd::ifelse(isNew, y, value);
+			value.store(&cvValues[c]);
+			((y - value) / float(interval)).store(&cvIncrements[c]);
+			b.store(&cvSteps[c]);
+			float_4 slope = tabread4Slope(a, b, cc, d, pos - i) * length * (inOutMax - inOutMin);
+			simd::clamp(slope, -10.f, 10.f).store(&cvSlopes[c]);
+		}
+		cvChannels = nChannels;
 	}
 
-	drwav_free(pSampleData);
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 value = float_4::load(&cvValues[c]) + float_4::load(&cvIncrements[c]);
+		value.store(&cvValues[c]);
+		float_4 step = float_4::load(&cvSteps[c]);
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(step, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(value, 0.f, 1.f, inOutMin, inOutMax), c);
+		if(slopeOutput) {
+			slopeOutput->setVoltageSimd(float_4::load(&cvSlopes[c]), c);
+		}
+	}
 }
 
-void Array::saveWav(std::string path) {
-	// use drwav to save the buffer as a wav file.
-	// based on VCV Fundamental wavetable.save();
-	drwav_data_format format;
-	format.container = drwav_container_riff;
-	format.format = DR_WAVE_FORMAT_PCM;
-	format.channels = 1;
-	format.sampleRate = sampleRate; // note: this doesn't really matter, because we're not using the info when reading the sample back
-	format.bitsPerSample = 16;
-
-	drwav wav;
-	if(!drwav_init_file_write(&wav, path.c_str(), &format))
-		return;
+void Array::processWavetable(const Wavetable &wt, ArrayExpander *expander, float inOutMin, float inOutMax) {
+	int frameSize = wt.frameSize;
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 phase = float_4::load(&phases[c]);
+		float_4 delta = float_4::load(&phaseDeltas[c]);
 
-	// Rescale from the range 0..1 to -1..1
-	std::vector<float> buffer_rescaled = buffer;
-	std::transform(buffer_rescaled.begin(), buffer_rescaled.end(), buffer_rescaled.begin(),
-			[](float y) -> float { return (y - 0.5f) * 2.f; });
+		float_4 frame = 0.f;
+		if(expander) {
+			float_4 scan = expander->inputs[ArrayExpander::SCAN_INPUT].getPolyVoltageSimd<float_4>(c);
+			frame = simd::clamp(scan * 0.1f, 0.f, 1.f) * (wt.numFrames - 1);
+		}
 
-	size_t len = buffer_rescaled.size();
-	int16_t* buf = new int16_t[len];
-	drwav_f32_to_s16(buf, buffer_rescaled.data(), len);
-	drwav_write_pcm_frames(&wav, len, buf);
-	delete[] buf;
+		float_4 y = wt.read(frame, phase, delta);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(y, 0.f, 1.f, inOutMin, inOutMax), c);
 
-	drwav_uninit(&wav);
+		// The step output reads the nearest frame directly
+		float_4 step;
+		for(int i = 0; i < 4; i++) {
+			int f = int(frame[i] + 0.5f);
+			int j = std::min(int(phase[i] * frameSize), frameSize - 1);
+			step[i] = buffer[f * frameSize + j];
+		}
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(step, 0.f, 1.f, inOutMin, inOutMax), c);
+	}
 }
 
-void Array::process(const ProcessArgs &args) {
-	sampleRate = args.sampleRate;
-
-	float phaseMin, phaseMax;
-	float prange = params[PHASE_RANGE_PARAM].getValue();
-	if(prange > 1.5f) {
-		phaseMin = 0.f;
-		phaseMax = 10.f;
-	} else if(prange > 0.5f) {
-		phaseMin = -5.f;
-		phaseMax =  5.f;
-	} else {
-		phaseMin = -10.f;
-		phaseMax =  10.f;
+void Array::processTerrain(const Terrain &terrain, ArrayExpander *expander, float phaseMin, float phaseMax, float inOutMin, float inOutMax) {
+	for(int c = 0; c < nChannels; c += 4) {
+		float_4 x = float_4::load(&phases[c]);
+		float_4 y = 0.f;
+		if(expander) {
+			// Y has the same range as POS
+			float_4 v = expander->inputs[ArrayExpander::Y_INPUT].getPolyVoltageSimd<float_4>(c);
+			y = simd::clamp(simd::rescale(v, phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
+		}
+		float_4 step;
+		float_4 z = terrainBicubic ? terrain.readBicubic(x, y, step) : terrain.readBilinear(x, y, step);
+		outputs[STEP_OUTPUT].setVoltageSimd(simd::rescale(step, 0.f, 1.f, inOutMin, inOutMax), c);
+		outputs[INTERP_OUTPUT].setVoltageSimd(simd::rescale(z, 0.f, 1.f, inOutMin, inOutMax), c);
 	}
+}
 
-	int size = buffer.size();
+void Array::workerStep() {
+	wavetableMailbox.collect();
+	convolutionMailbox.collect();
+	terrainMailbox.collect();
+	zeroCrossingsMailbox.collect();
+	slicesMailbox.collect();
+	integralMailbox.collect();
+	coefficientsMailbox.collect();
+	buildWavetable();
+	buildTerrain();
+	if(snapToZero) {
+		buildZeroCrossings();
+	}
+	if(slicesActive) {
+		buildSlices();
+	}
+	if(convolution) {
+		buildConvolutionKernel();
+	}
+	buildIntegral();
+	buildCoefficients();
+}
 
+// Build the integral table for the whole array when the engine requests it,
+// see syncIntegral()
+void Array::buildIntegral() {
+	if(!integralRequested.exchange(false)) return;
+	size_t lo, hi;
+	integralWorkerDirty.take(lo, hi);
+
+	std::unique_lock<std::mutex> lock(bufferMutex);
+	std::vector<float> x(buffer);
+	InterpBoundaryMode mode = boundaryMode;
+	lock.unlock();
+
+	int size = x.size();
+	IntegralTable *table = new IntegralTable();
+	table->boundaryMode = mode;
+	table->sums.resize(size);
+	table->sums.update(0, size, [&x, size, mode](int i) {
+		return segmentIntegral(x.data(), i, size, mode);
+	});
+	integralMailbox.post(table);
+}
 
-	float inOutMin, inOutMax;
-	float orange = params[OUTPUT_RANGE_PARAM].getValue();
-	if(orange > 1.5f) {
-		inOutMin = 0.f;
-		inOutMax = 10.f;
-	} else if(orange > 0.5f) {
-		inOutMin = -5.f;
-		inOutMax =  5.f;
-	} else {
-		inOutMin = -10.f;
-		inOutMax =  10.f;
+// Build the coefficient table for the whole array when the engine requests it,
+// and free it when the cache is turned off
+void Array::buildCoefficients() {
+	if(!cacheCoefficients) {
+		if(workerCoefficientsPosted) {
+			// The engine drops the old table when it gets the empty one
+			coefficientsMailbox.post(new CoefficientTable());
+			workerCoefficientsPosted = false;
+		}
+		return;
 	}
+	if(!coefficientsRequested.exchange(false)) return;
+	size_t lo, hi;
+	coefficientsWorkerDirty.take(lo, hi);
+
+	std::unique_lock<std::mutex> lock(bufferMutex);
+	std::vector<float> x(buffer);
+	InterpBoundaryMode mode = boundaryMode;
+	lock.unlock();
+
+	int size = x.size();
+	CoefficientTable *table = new CoefficientTable();
+	table->boundaryMode = mode;
+	table->k.resize(4 * size);
+	for(int i = 0; i < size; i++) {
+		int ia, ib, ic, id;
+		getInterpIndices(i, size, mode, ia, ib, ic, id);
+		float *k = &table->k[4 * i];
+		k[0] = x[ib];
+		tabread4Coefficients(x[ia], x[ib], x[ic], x[id], k[1], k[2], k[3]);
+	}
+	coefficientsMailbox.post(table);
+	workerCoefficientsPosted = true;
+}
 
-	// recording
-	recPhase = clamp(rescale(inputs[REC_PHASE_INPUT].getVoltage(), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
-	int ri = int(recPhase * size);
-	bool recWasTriggered = recTrigger.process(rescale(inputs[REC_ENABLE_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f));
-	bool recWasClicked = recClickTrigger.process(params[REC_ENABLE_PARAM].getValue());
+void Array::buildWavetable() {
+	int frames = wavetableFrames;
+	if(frames > 1) {
+		size_t lo, hi;
+		bool dirty = wavetableDirty.take(lo, hi);
+
+		std::unique_lock<std::mutex> lock(bufferMutex);
+		int frameSize = buffer.size() / frames;
+		if(frameSize < 1) return;
+
+		bool created = false;
+		if(!workerWavetable || workerWavetable->numFrames != frames || workerWavetable->frameSize != frameSize) {
+			workerWavetable.reset(new Wavetable(frames, frameSize));
+			created = true;
+			lo = 0;
+			hi = buffer.size();
+		} else if(!dirty) {
+			lock.unlock();
+			if(wavetableThrottle.tick(false)) {
+				wavetableMailbox.post(new Wavetable(*workerWavetable));
+			}
+			return;
+		}
 
-	if(recMode == GATE) {
-		isRecording = recTrigger.isHigh() || recClickTrigger.isHigh();
-	} else if(recMode == TOGGLE && (recWasTriggered || recWasClicked)) {
-		isRecording = !isRecording;
+		// Only rebuild the frames that have been modified
+		int first = std::min<int>(lo / frameSize, frames - 1);
+		int last = std::min<int>((hi - 1) / frameSize, frames - 1);
+		std::vector<float> x(buffer.begin() + first * frameSize, buffer.begin() + (last + 1) * frameSize);
+		lock.unlock();
+
+		workerWavetable->setFrames(x.data(), first, last);
+		// A new wavetable is posted right away, updates are throttled
+		if(created) {
+			wavetableThrottle = RepostThrottle();
+			wavetableMailbox.post(new Wavetable(*workerWavetable));
+		} else if(wavetableThrottle.tick(true)) {
+			wavetableMailbox.post(new Wavetable(*workerWavetable));
+		}
 	}
-	if(isRecording) {
-		buffer[ri] = clamp(rescale(inputs[REC_SIGNAL_INPUT].getVoltage(), inOutMin, inOutMax, 0.f, 1.f), 0.f, 1.f);
+}
+
+void Array::buildTerrain() {
+	int rows = terrainRows;
+	if(rows > 1) {
+		size_t lo, hi;
+		bool dirty = terrainDirty.take(lo, hi);
+
+		std::unique_lock<std::mutex> lock(bufferMutex);
+		int width = buffer.size() / rows;
+		if(width < 2) return;
+
+		bool created = false;
+		if(!workerTerrain || workerTerrain->height != rows || workerTerrain->width != width) {
+			workerTerrain.reset(new Terrain(width, rows));
+			created = true;
+			lo = 0;
+			hi = buffer.size();
+		} else if(!dirty) {
+			lock.unlock();
+			if(terrainThrottle.tick(false)) {
+				terrainMailbox.post(new Terrain(*workerTerrain));
+			}
+			return;
+		}
+
+		// Only copy the rows that have been modified
+		int first = std::min<int>(lo / width, rows - 1);
+		int last = std::min<int>((hi - 1) / width, rows - 1);
+		std::vector<float> x(buffer.begin() + first * width, buffer.begin() + (last + 1) * width);
+		lock.unlock();
+
+		workerTerrain->setRows(x.data(), first, last);
+		// A new grid is posted right away, updates are throttled
+		if(created) {
+			terrainThrottle = RepostThrottle();
+			terrainMailbox.post(new Terrain(*workerTerrain));
+		} else if(terrainThrottle.tick(true)) {
+			terrainMailbox.post(new Terrain(*workerTerrain));
+		}
 	}
-	lights[REC_LIGHT].setBrightness(isRecording);
+}
 
-	nChannels = inputs[PHASE_INPUT].getChannels();
-	outputs[STEP_OUTPUT].setChannels(nChannels);
-	outputs[INTERP_OUTPUT].setChannels(nChannels);
-	for(int chan = 0; chan < nChannels; chan++) {
-		float phase = clamp(rescale(inputs[PHASE_INPUT].getVoltage(chan), phaseMin, phaseMax, 0.f, 1.f), 0.f, 1.f);
-		phases[chan] = phase;
-		// direct output
-		int i_step = clamp((int) std::floor(phase * size), 0, size - 1);
-		outputs[STEP_OUTPUT].setVoltage(rescale(buffer[i_step], 0.f, 1.f, inOutMin, inOutMax), chan);
+void Array::buildZeroCrossings() {
+	size_t lo, hi;
+	bool dirty = zeroCrossingsDirty.take(lo, hi);
+	// The whole index is rebuilt, scanning the array is fast compared to the
+	// polling interval.
+	std::unique_lock<std::mutex> lock(bufferMutex);
+	float zero = getZeroValue();
+	if(!dirty && workerZeroCrossingsSize == int(buffer.size()) && workerZeroCrossingsZero == zero) return;
+	ZeroCrossings *zc = new ZeroCrossings(buffer.data(), buffer.size(), zero);
+	lock.unlock();
+	workerZeroCrossingsSize = zc->size;
+	workerZeroCrossingsZero = zero;
+	zeroCrossingsMailbox.post(zc);
+}
 
-		// interpolated output, based on tabread4_tilde_perform() in
-		// https://github.com/pure-data/pure-data/blob/master/src/d_array.c
-		//TODO: adjust symmetry of surrounding indices (based on range polarity)?
-		int i = i_step;
-		int ia, ib, ic, id;
-		switch(boundaryMode) {
-			case INTERP_CONSTANT:
-				{
-					ia = clamp(i - 1, 0, size - 1);
-					ib = clamp(i + 0, 0, size - 1);
-					ic = clamp(i + 1, 0, size - 1);
-					id = clamp(i + 2, 0, size - 1);
-					break;
-				}
-			case INTERP_MIRROR:
-				{
-					ia = i < 1 ? 1 : i - 1;
-					ib = i;
-					ic = i + 1 < size ? i + 1 : size - 1;
-					id = i + 2 < size ? i + 2 : 2*size - (i + 3);
-					break;
-				}
-			case INTERP_PERIODIC:
-			default:
-				{
-					ia = (i - 1 + size) % size;
-					ib = (i + 0) % size;
-					ic = (i + 1) % size;
-					id = (i + 2) % size;
-					break;
-				}
+void Array::buildSlices() {
+	size_t lo, hi;
+	bool dirty = slicesDirty.take(lo, hi);
+	std::unique_lock<std::mutex> lock(bufferMutex);
+	float zero = getZeroValue();
+	if(workerSlicesSize == int(buffer.size()) && workerSlicesZero == zero) {
+		// The whole array is analyzed, so wait until it hasn't been modified
+		// for a tick, e.g. until recording has stopped
+		if(dirty) {
+			workerSlicesStale = true;
+			return;
+		}
+		if(!workerSlicesStale) return;
+	}
+	workerSlicesStale = false;
+	// The analysis takes a while for long samples, so work on a copy
+	std::vector<float> x = buffer;
+	lock.unlock();
+
+	Slices *slices = new Slices(x.data(), x.size(), zero);
+	workerSlicesSize = slices->size;
+	workerSlicesZero = zero;
+	slicesMailbox.post(slices);
+}
+
+void Array::buildConvolutionKernel() {
+	size_t lo, hi;
+	bool dirty = convolutionDirty.take(lo, hi);
+
+	std::unique_lock<std::mutex> lock(bufferMutex);
+	int length = buffer.size();
+	float zero = getZeroValue();
+	bool created = false;
+	if(!workerKernel || workerKernel->length != length || workerKernel->zero != zero) {
+		workerKernel.reset(new ConvolutionKernel(length, zero));
+		created = true;
+		lo = 0;
+		hi = length;
+	} else if(!dirty) {
+		lock.unlock();
+		if(kernelThrottle.tick(false)) {
+			postConvolutionKernel();
 		}
-		float a = buffer[ia];
-		float b = buffer[ib];
-		float c = buffer[ic];
-		float d = buffer[id];
+		return;
+	}
 
-		// Pd algorithm magic
-		float frac = phase * size - i; // fractional part of phase
-		float y = b + frac * (
-				c - b - 0.1666667f * (1.f - frac) * (
-					(d - a - 3.f * (c - b)) * frac + (d + 2.f * a - 3.f * b)
-					)
-				);
-		outputs[INTERP_OUTPUT].setVoltage(rescale(y, 0.f, 1.f, inOutMin, inOutMax), chan);
+	// Only rebuild the partitions that have been modified
+	int B = ConvolutionKernel::BLOCK_SIZE;
+	int last = std::min<int>((std::min<int>(hi, length) - 1) / B, workerKernel->numPartitions - 1);
+	int first = std::min<int>(lo / B, last);
+	std::vector<float> x(buffer.begin() + first * B, buffer.begin() + std::min((last + 1) * B, length));
+	lock.unlock();
+
+	workerKernel->setPartitions(x.data(), first, last);
+	// A new kernel is posted right away, updates are throttled
+	if(created) {
+		kernelThrottle = RepostThrottle();
+		postConvolutionKernel();
+	} else if(kernelThrottle.tick(true)) {
+		postConvolutionKernel();
 	}
+}
 
+void Array::postConvolutionKernel() {
+	ConvolutionKernel *kernel = new ConvolutionKernel(*workerKernel);
+	kernel->allocateHistory();
+	convolutionMailbox.post(kernel);
 }
 
 struct ArrayDisplay : OpaqueWidget {
@@ -549,6 +2879,7 @@ struct ArrayDisplay : OpaqueWidget {
 		if(abs(i1 - i2) < 2) {
 			float y = clamp(rescale(dragPosition.y, 0, bs.y, 1.f, 0.f), 0.f, 1.f);
 			module->buffer[i2] = y;
+			module->markDirty(i2, i2 + 1);
 		} else {
 			// mouse moved more than one index, interpolate
 			float y1 = clamp(rescale(dragPosition_old.y, 0, bs.y, 1.f, 0.f), 0.f, 1.f);
@@ -561,6 +2892,7 @@ struct ArrayDisplay : OpaqueWidget {
 				float y = y1 + rescale(i, i1, i2, 0.f, 1.0f) * (y2 - y1);
 				module->buffer[i] = y;
 			}
+			module->markDirty(i1, i2 + 1);
 		}
 	}
 
@@ -602,6 +2934,7 @@ struct ArraySetBufferToZeroItem : MenuItem {
 	void onAction(const event::Action &e) override {
 		auto& buf = module->buffer;
 		std::fill(buf.begin(), buf.end(), module->getZeroValue());
+		module->markDirty(0, buf.size());
 	}
 };
 
@@ -609,6 +2942,7 @@ struct ArraySortBufferItem : MenuItem {
 	Array *module;
 	void onAction(const event::Action &e) override {
 		std::sort(module->buffer.begin(), module->buffer.end());
+		module->markDirty(0, module->buffer.size());
 	}
 };
 
@@ -630,6 +2964,8 @@ struct ArrayAddFadesMenuItem : MenuItem {
 				buf[i] = crossfade(zero, buf[i], fac);
 				buf[bufSize - 1 - i] = crossfade(zero, buf[bufSize - 1 - i], fac);
 			}
+			module->markDirty(0, nFade);
+			module->markDirty(bufSize - nFade, bufSize);
 		}
 	}
 };
@@ -639,13 +2975,14 @@ struct ArrayAddFadesMenuItem : MenuItem {
 struct ArrayFileSelectItem : MenuItem {
 	Array *module;
 	bool resizeBuffer;
+	bool loadLanes = false;
 
 	void onAction(const event::Action &e) override {
 		std::string dir = module->lastLoadedPath.empty() ? asset::user("") : rack::system::getDirectory(module->lastLoadedPath);
 		osdialog_filters* filters = osdialog_filters_parse(".wav files:wav");
 		char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, filters);
 		if(path) {
-			module->loadSample(path, resizeBuffer);
+			module->loadSample(path, resizeBuffer, loadLanes);
 			module->lastLoadedPath = path;
 			module->enableEditing = false; // disable editing for loaded wav files
 			free(path);
@@ -654,6 +2991,43 @@ struct ArrayFileSelectItem : MenuItem {
 	}
 };
 
+struct ArrayAntiAliasingMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->antiAliasing = !module->antiAliasing;
+	}
+};
+
+struct ArraySnapToZeroMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->snapToZero = !module->snapToZero;
+	}
+};
+
+struct ArrayConvolutionMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->convolution = !module->convolution;
+		module->updateConvolutionRenderer();
+	}
+};
+
+struct ArrayConvolutionOnWorkerMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->convolutionOnWorker = !module->convolutionOnWorker;
+		module->updateConvolutionRenderer();
+	}
+};
+
+struct ArrayCacheCoefficientsMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->cacheCoefficients = !module->cacheCoefficients;
+	}
+};
+
 struct ArrayEnableEditingMenuItem : MenuItem {
 	Array *module;
 	bool valueToSet;
@@ -682,6 +3056,7 @@ struct ArrayEnumSettingChildMenuItem : MenuItem {
 		}
 	void onAction(const event::Action &e) override {
 		*memberToSet = mode;
+		module->onSettingChanged();
 	}
 };
 
@@ -691,6 +3066,7 @@ struct ArrayRecordingModeMenuItem : MenuItemWithRightArrow {
 		Menu *menu = new Menu();
 		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::RecordingMode>(this->module, Array::GATE, "Gate", &module->recMode));
 		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::RecordingMode>(this->module, Array::TOGGLE, "Toggle", &module->recMode));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::RecordingMode>(this->module, Array::CAPTURE, "One-shot capture", &module->recMode));
 
 		return menu;
 	}
@@ -722,6 +3098,277 @@ struct ArrayInterpModeMenuItem : MenuItemWithRightArrow {
 	}
 };
 
+// Slider with a logarithmic scale for the spectral processing settings
+struct ArrayLogQuantity : Quantity {
+	float *value;
+	float minValue, maxValue, defaultValue;
+	std::string label, unit;
+
+	ArrayLogQuantity(float *pValue, float pMin, float pMax, float pDefault, std::string pLabel, std::string pUnit) {
+		value = pValue;
+		minValue = pMin;
+		maxValue = pMax;
+		defaultValue = pDefault;
+		label = pLabel;
+		unit = pUnit;
+	}
+
+	// The slider position is the base 2 logarithm of the value
+	float getValue() override { return std::log2(*value); }
+	void setValue(float v) override { *value = std::pow(2.f, clamp(v, getMinValue(), getMaxValue())); }
+	float getMinValue() override { return std::log2(minValue); }
+	float getMaxValue() override { return std::log2(maxValue); }
+	float getDefaultValue() override { return std::log2(defaultValue); }
+	float getDisplayValue() override { return *value; }
+	void setDisplayValue(float v) override { setValue(std::log2(std::max(v, minValue))); }
+	std::string getLabel() override { return label; }
+	std::string getUnit() override { return unit; }
+};
+
+struct ArrayLogSlider : ui::Slider {
+	ArrayLogSlider(float *value, float minValue, float maxValue, float defaultValue, std::string label, std::string unit) {
+		quantity = new ArrayLogQuantity(value, minValue, maxValue, defaultValue, label, unit);
+		box.size.x = 200.f;
+	}
+	~ArrayLogSlider() {
+		delete quantity;
+	}
+};
+
+struct ArrayHarmonicsField : TextField {
+	Array *module;
+	ArrayHarmonicsField(Array *m) : TextField() {
+		module = m;
+		box.size.x = 200.f;
+		placeholder = "Amplitudes of harmonics 1, 2, 3...";
+		text = module->harmonics;
+	}
+	void onChange(const event::Change &e) override {
+		module->harmonics = text;
+	}
+};
+
+struct ArraySpectralMenuItem : MenuItem {
+	Array *module;
+	Array::SpectralOperation op;
+	ArraySpectralMenuItem(Array *pModule, Array::SpectralOperation pOp, std::string label) {
+		module = pModule;
+		op = pOp;
+		text = label;
+		disabled = module->isSpectralJobBusy();
+	}
+	void onAction(const event::Action &e) override {
+		module->startSpectralJob(op);
+	}
+};
+
+struct ArraySpectralMenu : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+
+		if(module->isSpectralJobBusy()) {
+			menu->addChild(createMenuLabel("Processing..."));
+		}
+
+		menu->addChild(new ArrayLogSlider(&module->spectralCutoff, 10.f, module->sampleRate * 0.5f, 1000.f, "Cutoff", " Hz"));
+		menu->addChild(new ArraySpectralMenuItem(module, Array::SPECTRAL_LOWPASS, "Low-pass filter"));
+		menu->addChild(new ArraySpectralMenuItem(module, Array::SPECTRAL_HIGHPASS, "High-pass filter"));
+
+		menu->addChild(new MenuLabel()); // spacer
+		menu->addChild(new ArrayLogSlider(&module->smoothingWidth, 1.f, 10000.f, 10.f, "Smoothing width", " samples"));
+		menu->addChild(new ArraySpectralMenuItem(module, Array::SPECTRAL_SMOOTH, "Smooth"));
+
+		menu->addChild(new MenuLabel()); // spacer
+		menu->addChild(createMenuLabel("Harmonic amplitudes"));
+		menu->addChild(new ArrayHarmonicsField(module));
+		menu->addChild(new ArraySpectralMenuItem(module, Array::SPECTRAL_SINESUM, "Fill with sine harmonics"));
+		menu->addChild(new ArraySpectralMenuItem(module, Array::SPECTRAL_COSINESUM, "Fill with cosine harmonics"));
+
+		return menu;
+	}
+};
+
+struct ArrayPositionModeMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::PositionMode>(module, Array::POSITION_INPUT, "POS input", &module->positionMode));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::PositionMode>(module, Array::POSITION_OSCILLATOR, "Internal oscillator (POS is V/Oct)", &module->positionMode));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::PositionMode>(module, Array::POSITION_DELAY, "Delay line (POS is delay time)", &module->positionMode));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::PositionMode>(module, Array::POSITION_GRANULAR, "Granular (POS is grain position)", &module->positionMode));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<Array::PositionMode>(module, Array::POSITION_PLAYER, "Sample player (POS is V/Oct)", &module->positionMode));
+		return menu;
+	}
+};
+
+struct ArrayOversamplingMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, 1, "Off", &module->oversampling));
+		for(int factor = 2; factor <= 8; factor *= 2) {
+			menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, factor, string::f("%dx", factor), &module->oversampling));
+		}
+		return menu;
+	}
+};
+
+struct ArrayCVRateMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, 1, "Off", &module->cvRate));
+		for(int interval = 4; interval <= Array::CV_RATE_MAX_INTERVAL; interval *= 4) {
+			menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, interval, string::f("Every %d samples", interval), &module->cvRate));
+		}
+		menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, Array::CV_RATE_ADAPTIVE, "Adaptive (follows POS speed)", &module->cvRate));
+		return menu;
+	}
+};
+
+struct ArrayBlockProcessingMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->blockProcessing = !module->blockProcessing;
+	}
+};
+
+struct ArrayQualityGovernorMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<float>(module, 0.f, "Off", &module->governor.budget));
+		for(float percent : {0.5f, 1.f, 2.f, 5.f}) {
+			menu->addChild(new ArrayEnumSettingChildMenuItem<float>(module, 0.01f * percent, string::f("%g%% CPU", percent), &module->governor.budget));
+		}
+		if(module->governor.budget > 0.f) {
+			static const char *tierNames[Array::NUM_QUALITY_TIERS] = {
+				"Full quality",
+				"Oversampling up to 4x",
+				"Oversampling up to 2x",
+				"No oversampling",
+				"No oversampling or ADAA",
+			};
+			menu->addChild(new MenuSeparator);
+			menu->addChild(createMenuLabel(string::f("Current: %s", tierNames[module->governor.tier])));
+			menu->addChild(createMenuLabel(string::f("Average load: %.2f%%", 100.f * module->governor.averageCost)));
+		}
+		return menu;
+	}
+};
+
+struct ArrayTapeModeMenuItem : MenuItem {
+	Array *module;
+	void onAction(const event::Action &e) override {
+		module->setTapeMode(!module->tapeMode);
+	}
+};
+
+struct ArrayTapeDirectoryMenuItem : MenuItem {
+	Array *module;
+	bool usePatchStorage = false;
+	void onAction(const event::Action &e) override {
+		if(usePatchStorage) {
+			module->tapeDirectory = "";
+		} else {
+			std::string dir = module->tape.getDirectory();
+			char *path = osdialog_file(OSDIALOG_OPEN_DIR, dir.c_str(), NULL, NULL);
+			if(!path) return;
+			module->tapeDirectory = path;
+			free(path);
+		}
+		module->updateTapeDirectory();
+	}
+};
+
+struct ArrayTapeMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+
+		auto *modeItem = new ArrayTapeModeMenuItem();
+		modeItem->module = module;
+		modeItem->text = "Record to disk";
+		modeItem->rightText = CHECKMARK(module->tapeMode);
+		menu->addChild(modeItem);
+
+		menu->addChild(createMenuLabel(module->tapeDirectory.empty() ? "Folder: patch storage" : "Folder: " + module->tapeDirectory));
+
+		auto *dirItem = new ArrayTapeDirectoryMenuItem();
+		dirItem->module = module;
+		dirItem->text = "Choose folder...";
+		menu->addChild(dirItem);
+
+		auto *storageItem = new ArrayTapeDirectoryMenuItem();
+		storageItem->module = module;
+		storageItem->usePatchStorage = true;
+		storageItem->text = "Use patch storage folder";
+		storageItem->rightText = CHECKMARK(module->tapeDirectory.empty());
+		menu->addChild(storageItem);
+
+		std::string lastPath = module->tape.getLastPath();
+		if(!lastPath.empty()) {
+			menu->addChild(createMenuLabel("Last take: " + system::getFilename(lastPath)));
+		}
+		if(module->tape.droppedFrames > 0) {
+			menu->addChild(createMenuLabel(string::f("Dropped %d frames", int(module->tape.droppedFrames))));
+		}
+		return menu;
+	}
+};
+
+struct ArrayNumLanesChildMenuItem : MenuItem {
+	Array *module;
+	int numLanes;
+	void onAction(const event::Action &e) override {
+		module->setNumLanes(numLanes);
+	}
+};
+
+struct ArrayNumLanesMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		for(int n = 1; n <= MAX_POLY_CHANNELS; n++) {
+			auto *item = new ArrayNumLanesChildMenuItem();
+			item->module = module;
+			item->numLanes = n;
+			item->text = n == 1 ? "1 (off)" : string::f("%d", n);
+			item->rightText = CHECKMARK(module->getNewNumLanes() == n);
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+struct ArrayWavetableMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, 1, "Off", &module->wavetableFrames));
+		for(int frames = 2; frames <= 256; frames *= 2) {
+			menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, frames, string::f("%d frames", frames), &module->wavetableFrames));
+		}
+		return menu;
+	}
+};
+
+struct ArrayTerrainMenuItem : MenuItemWithRightArrow {
+	Array *module;
+	Menu *createChildMenu() override {
+		Menu *menu = new Menu();
+		menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, 1, "Off", &module->terrainRows));
+		for(int rows = 2; rows <= 1024; rows *= 2) {
+			menu->addChild(new ArrayEnumSettingChildMenuItem<int>(module, rows, string::f("%d rows", rows), &module->terrainRows));
+		}
+		menu->addChild(new MenuSeparator());
+		menu->addChild(new ArrayEnumSettingChildMenuItem<bool>(module, false, "Bilinear interpolation", &module->terrainBicubic));
+		menu->addChild(new ArrayEnumSettingChildMenuItem<bool>(module, true, "Bicubic interpolation", &module->terrainBicubic));
+		return menu;
+	}
+};
+
 struct ArrayModuleWidget : ModuleWidget {
 	ArrayDisplay *display;
 	ArraySizeSelector *sizeSelector;
@@ -798,6 +3445,12 @@ struct ArrayModuleWidget : ModuleWidget {
 			rmItem->module = this->module;
 			menu->addChild(rmItem);
 
+			auto *tapeSubMenu = new ArrayTapeMenuItem();
+			tapeSubMenu->text = "Tape recording";
+			tapeSubMenu->rightText = (arr->tapeMode ? "On " : "") + std::string(RIGHT_ARROW);
+			tapeSubMenu->module = arr;
+			menu->addChild(tapeSubMenu);
+
 			{
 			auto *fsItem = new ArrayFileSelectItem();
 			float duration = arr->buffer.size() * 1.f / arr->sampleRate;
@@ -816,6 +3469,21 @@ struct ArrayModuleWidget : ModuleWidget {
 			menu->addChild(fsItem);
 			}
 
+			{
+			auto *fsItem = new ArrayFileSelectItem();
+			fsItem->resizeBuffer = true;
+			fsItem->loadLanes = true;
+			fsItem->text = "Load multichannel .wav file into lanes...";
+			fsItem->module = arr;
+			menu->addChild(fsItem);
+			}
+
+			auto *lanesSubMenu = new ArrayNumLanesMenuItem();
+			lanesSubMenu->text = "Lanes";
+			lanesSubMenu->rightText = (arr->getNewNumLanes() > 1 ? string::f("%d ", arr->getNewNumLanes()) : "") + RIGHT_ARROW;
+			lanesSubMenu->module = arr;
+			menu->addChild(lanesSubMenu);
+
 			auto *saveModeSubMenu = new ArrayDataSaveModeMenuItem();
 			saveModeSubMenu->text = "Data persistence";
 			saveModeSubMenu->module = this->module;
@@ -825,6 +3493,87 @@ struct ArrayModuleWidget : ModuleWidget {
 			interpModeSubMenu->text = "Interpolation at boundary";
 			interpModeSubMenu->module = this->module;
 			menu->addChild(interpModeSubMenu);
+
+			auto *aaItem = new ArrayAntiAliasingMenuItem();
+			aaItem->text = "Anti-aliasing (ADAA)";
+			aaItem->module = arr;
+			aaItem->rightText = CHECKMARK(arr->antiAliasing);
+			menu->addChild(aaItem);
+
+			auto *oversamplingSubMenu = new ArrayOversamplingMenuItem();
+			oversamplingSubMenu->text = "Oversampling";
+			oversamplingSubMenu->rightText = (arr->oversampling > 1 ? string::f("%dx ", arr->oversampling) : "") + RIGHT_ARROW;
+			oversamplingSubMenu->module = this->module;
+			menu->addChild(oversamplingSubMenu);
+
+			auto *cvRateSubMenu = new ArrayCVRateMenuItem();
+			cvRateSubMenu->text = "CV rate (read less often)";
+			cvRateSubMenu->rightText = (arr->cvRate == Array::CV_RATE_ADAPTIVE ? std::string("Adaptive ") : arr->cvRate > 1 ? string::f("%d ", arr->cvRate) : "") + RIGHT_ARROW;
+			cvRateSubMenu->module = this->module;
+			menu->addChild(cvRateSubMenu);
+
+			auto *blockItem = new ArrayBlockProcessingMenuItem();
+			blockItem->text = string::f("Block processing for mono waveshaping (+%d samples latency)", Array::BLOCK_MODE_SIZE);
+			blockItem->module = arr;
+			blockItem->rightText = CHECKMARK(arr->blockProcessing);
+			menu->addChild(blockItem);
+
+			auto *governorSubMenu = new ArrayQualityGovernorMenuItem();
+			governorSubMenu->text = "Quality governor";
+			governorSubMenu->rightText = (arr->governor.budget > 0.f ? string::f("%g%% ", 100.f * arr->governor.budget) : "") + RIGHT_ARROW;
+			governorSubMenu->module = this->module;
+			menu->addChild(governorSubMenu);
+
+			auto *ccItem = new ArrayCacheCoefficientsMenuItem();
+			ccItem->text = "Precompute interpolation (faster, uses more memory)";
+			ccItem->module = arr;
+			ccItem->rightText = CHECKMARK(arr->cacheCoefficients);
+			menu->addChild(ccItem);
+
+			auto *snapItem = new ArraySnapToZeroMenuItem();
+			snapItem->text = "Snap POS jumps to zero crossings";
+			snapItem->module = arr;
+			snapItem->rightText = CHECKMARK(arr->snapToZero);
+			menu->addChild(snapItem);
+
+			auto *positionModeSubMenu = new ArrayPositionModeMenuItem();
+			positionModeSubMenu->text = "Playback position";
+			positionModeSubMenu->module = this->module;
+			menu->addChild(positionModeSubMenu);
+
+			auto *convItem = new ArrayConvolutionMenuItem();
+			convItem->text = "Convolve REC IN with the array";
+			convItem->module = arr;
+			convItem->rightText = CHECKMARK(arr->convolution);
+			menu->addChild(convItem);
+
+			if(arr->convolution) {
+				auto *convWorkerItem = new ArrayConvolutionOnWorkerMenuItem();
+				convWorkerItem->text = string::f("Convolve on a separate thread (+%d samples latency)", arr->convolutionRenderer.getLatency());
+				convWorkerItem->module = arr;
+				convWorkerItem->rightText = CHECKMARK(arr->convolutionOnWorker);
+				menu->addChild(convWorkerItem);
+				if(arr->convolutionOnWorker) {
+					menu->addChild(createMenuLabel(string::f("Dropouts: %d samples", arr->convolutionRenderer.underruns.load())));
+				}
+			}
+
+			auto *wavetableSubMenu = new ArrayWavetableMenuItem();
+			wavetableSubMenu->text = "Wavetable mode";
+			wavetableSubMenu->rightText = (arr->wavetableFrames > 1 ? string::f("%d frames ", arr->wavetableFrames) : "") + RIGHT_ARROW;
+			wavetableSubMenu->module = this->module;
+			menu->addChild(wavetableSubMenu);
+
+			auto *terrainSubMenu = new ArrayTerrainMenuItem();
+			terrainSubMenu->text = "Wave terrain";
+			terrainSubMenu->rightText = (arr->terrainRows > 1 ? string::f("%d rows ", arr->terrainRows) : "") + RIGHT_ARROW;
+			terrainSubMenu->module = this->module;
+			menu->addChild(terrainSubMenu);
+
+			auto *spectralSubMenu = new ArraySpectralMenu();
+			spectralSubMenu->text = "Spectral processing";
+			spectralSubMenu->module = this->module;
+			menu->addChild(spectralSubMenu);
 		}
 
 	}
@@ -0,0 +1,35 @@
+#include "ArrayExpander.hpp"
+#include "Util.hpp"
+
+struct ArrayExpanderWidget : ModuleWidget {
+	ArrayExpanderWidget(ArrayExpander *module) {
+		setModule(module);
+		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/ArrayExpander.svg")));
+
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		addChild(createLightCentered<TinyLight<GreenLight>>(Vec(8.f, 24.f), module, ArrayExpander::CONNECTED_LIGHT));
+
+		addInput(createInputCentered<PJ301MPort>(Vec(22.5f, 70.f), module, ArrayExpander::SCAN_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(60.f, 70.f), module, ArrayExpander::FM_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(97.5f, 70.f), module, ArrayExpander::Y_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(22.5f, 120.f), module, ArrayExpander::DENSITY_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(60.f, 120.f), module, ArrayExpander::SIZE_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(97.5f, 120.f), module, ArrayExpander::VALUE_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(22.5f, 170.f), module, ArrayExpander::WIDTH_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(60.f, 170.f), module, ArrayExpander::SLICE_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(22.5f, 220.f), module, ArrayExpander::START_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(60.f, 220.f), module, ArrayExpander::LENGTH_INPUT));
+		addInput(createInputCentered<PJ301MPort>(Vec(97.5f, 170.f), module, ArrayExpander::GATE_INPUT));
+
+		addOutput(createOutputCentered<PJ301MPort>(Vec(22.5f, 285.f), module, ArrayExpander::EOC_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(Vec(60.f, 285.f), module, ArrayExpander::SLOPE_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(Vec(97.5f, 285.f), module, ArrayExpander::INV_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(Vec(22.5f, 340.f), module, ArrayExpander::AVG_OUTPUT));
+	}
+};
+
+
+Model *modelArrayExpander = createModel<ArrayExpander, ArrayExpanderWidget>("ArrayExpander");
@@ -0,0 +1,60 @@
+#pragma once
+#include "plugin.hpp"
+
+// Additional inputs and outputs for Array, placed to the right of it. Array
+// reads and writes these ports directly in its own process(), so the expander
+// itself doesn't do any processing.
+struct ArrayExpander : Module {
+	enum ParamIds {
+		NUM_PARAMS
+	};
+	enum InputIds {
+		SCAN_INPUT,
+		FM_INPUT,
+		Y_INPUT,
+		DENSITY_INPUT,
+		SIZE_INPUT,
+		VALUE_INPUT,
+		WIDTH_INPUT,
+		SLICE_INPUT,
+		START_INPUT,
+		LENGTH_INPUT,
+		GATE_INPUT,
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		EOC_OUTPUT,
+		SLOPE_OUTPUT,
+		INV_OUTPUT,
+		AVG_OUTPUT,
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		CONNECTED_LIGHT,
+		NUM_LIGHTS
+	};
+
+	ArrayExpander() {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		configInput(SCAN_INPUT, "Wavetable frame");
+		configInput(FM_INPUT, "Oscillator linear FM");
+		configInput(Y_INPUT, "Wave terrain Y position");
+		configInput(DENSITY_INPUT, "Grain density");
+		configInput(SIZE_INPUT, "Grain size");
+		configInput(VALUE_INPUT, "Inverse lookup value");
+		configInput(WIDTH_INPUT, "Average window width");
+		configInput(SLICE_INPUT, "Slice select");
+		configInput(START_INPUT, "Read window start");
+		configInput(LENGTH_INPUT, "Read window length");
+		configInput(GATE_INPUT, "Sample player gate");
+		configOutput(EOC_OUTPUT, "End of capture");
+		configOutput(SLOPE_OUTPUT, "Slope of the smooth output");
+		configOutput(INV_OUTPUT, "Inverse lookup position");
+		configOutput(AVG_OUTPUT, "Windowed average");
+		configLight(CONNECTED_LIGHT, "Connected to Array");
+	}
+
+	void process(const ProcessArgs &args) override {
+		lights[CONNECTED_LIGHT].setBrightness(leftExpander.module && leftExpander.module->model == modelArray);
+	}
+};
@@ -0,0 +1,126 @@
+#include "BlockRenderer.hpp"
+
+BlockRenderer::~BlockRenderer() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		destroying = true;
+	}
+	cv.notify_one();
+	if(thread.joinable()) thread.join();
+}
+
+void BlockRenderer::setup(int inChannels, int outChannels, RenderFunction render) {
+	this->inChannels = inChannels;
+	this->outChannels = outChannels;
+	this->render = render;
+	blockIn.resize(BLOCK_SIZE * inChannels);
+	blockOut.resize(BLOCK_SIZE * outChannels);
+}
+
+void BlockRenderer::setActive(bool active) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->active = active;
+		if(!active || threadRunning) return;
+	}
+	// the previous thread has exited by itself
+	if(thread.joinable()) thread.join();
+	threadRunning = true;
+	thread = std::thread([this]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!destroying) {
+			if(!this->active) {
+				// Ask the engine thread to stop using the renderer. It's
+				// safe to do this here, since the engine thread only
+				// changes a running renderer to STOPPING as well.
+				int expected = RUNNING;
+				state.compare_exchange_strong(expected, STOPPING);
+			}
+			lock.unlock();
+			renderStep();
+			lock.lock();
+			if(!this->active && state == IDLE) break;
+			// The engine thread wakes the render thread when a block is
+			// ready. The timeout is a fallback for a missed wakeup, and for
+			// noticing when the engine thread stops the renderer.
+			cv.wait_for(lock, std::chrono::milliseconds(state == IDLE ? 20 : 1));
+		}
+		threadRunning = false;
+	});
+}
+
+int BlockRenderer::getLatency() {
+	return state == RUNNING ? latency.load() : latencyFor(APP->engine->getBlockFrames());
+}
+
+bool BlockRenderer::process(bool enable, const float *in, float *out) {
+	int s = state;
+	if(s != IDLE && !threadRunning) {
+		// The render thread exited just as the renderer was started, the
+		// rendering state is not used anymore.
+		s = IDLE;
+		state = s;
+	}
+	if(s == IDLE) {
+		if(!enable || !threadRunning) return false;
+		// The render thread doesn't use the ring buffers while idle. Start
+		// with the latency worth of silence in the output.
+		engineBlockFrames = APP->engine->getBlockFrames();
+		latency = latencyFor(engineBlockFrames);
+		inRing.clear();
+		outRing.clear();
+		for(int i = 0; i < latency * outChannels; i++) {
+			outRing.push(0.f);
+		}
+		pushedFrames = 0;
+		underruns = 0;
+		s = RUNNING;
+		state = s;
+	} else if(s == RUNNING && !enable) {
+		s = STOPPING;
+		state = s;
+	}
+
+	if(s == RUNNING) {
+		if(inRing.capacity() >= size_t(inChannels)) {
+			inRing.pushBuffer(in, inChannels);
+		}
+		// Unlike locking the mutex, notifying doesn't block the engine thread
+		if(++pushedFrames >= BLOCK_SIZE) {
+			pushedFrames = 0;
+			cv.notify_one();
+			if(APP->engine->getBlockFrames() > engineBlockFrames && engineBlockFrames < MAX_ENGINE_BLOCK) {
+				// restarted with the new latency once the render thread
+				// has stopped
+				state = STOPPING;
+			}
+		}
+	}
+
+	if(outRing.size() >= size_t(outChannels)) {
+		outRing.shiftBuffer(out, outChannels);
+	} else {
+		std::fill(out, out + outChannels, 0.f);
+		if(s == RUNNING) underruns++;
+	}
+	return true;
+}
+
+void BlockRenderer::renderStep() {
+	int s = state;
+	if(s == STOPPING) {
+		// The engine thread waits for this before using the state of the
+		// render function again.
+		state = IDLE;
+		return;
+	}
+	if(s != RUNNING) return;
+
+	while(inRing.size() >= size_t(BLOCK_SIZE * inChannels) && state == RUNNING) {
+		inRing.shiftBuffer(blockIn.data(), blockIn.size());
+		render(blockIn.data(), blockOut.data(), BLOCK_SIZE);
+		if(outRing.capacity() >= blockOut.size()) {
+			outRing.pushBuffer(blockOut.data(), blockOut.size());
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "plugin.hpp"
+#include "Util.hpp"
+#include <vector>
+
+// Runs block-based processing on a separate thread, one block ahead of the
+// engine thread, so that heavy processing doesn't have to fit within the time
+// of a single sample. The engine thread pushes input frames and pops output
+// frames through lock-free ring buffers, and the output is delayed by a fixed
+// latency. If the render thread can't keep up, the missing output is silent.
+struct BlockRenderer {
+	static const int BLOCK_SIZE = 256;
+	// Rack processes each audio buffer (engine block) in one quick burst, so
+	// a block that is completed during one engine block can only be rendered
+	// while the engine waits for the next one. The latency must therefore
+	// cover a whole engine block, in addition to BLOCK_SIZE for collecting
+	// the input of a block. Engine blocks larger than this are not supported,
+	// and cause dropouts.
+	static const int MAX_ENGINE_BLOCK = 8192;
+
+	// Processes frames frames of interleaved input into interleaved output
+	typedef std::function<void(const float *in, float *out, int frames)> RenderFunction;
+
+	~BlockRenderer();
+
+	void setup(int inChannels, int outChannels, RenderFunction render);
+
+	// UI thread: the render thread only runs while the renderer is active.
+	// When it's deactivated, the thread exits once the engine thread has
+	// stopped using it.
+	void setActive(bool active);
+
+	// Engine thread: process one frame, if the renderer is enabled. When it's
+	// disabled, returns false once the render thread has stopped, and the
+	// caller should then process the frame itself.
+	bool process(bool enable, const float *in, float *out);
+
+	// The latency for the given engine block size, in samples
+	static int latencyFor(int engineBlockFrames) {
+		return clamp(engineBlockFrames, BLOCK_SIZE, MAX_ENGINE_BLOCK) + BLOCK_SIZE;
+	}
+
+	// The current latency, or the latency that would be used if the
+	// renderer was started now
+	int getLatency();
+
+	// Number of output frames that were missing, because the render thread
+	// didn't finish in time
+	std::atomic<int> underruns{0};
+
+private:
+	enum State {
+		IDLE,
+		RUNNING,
+		STOPPING,
+	};
+	std::atomic<int> state{IDLE};
+	int inChannels = 1;
+	int outChannels = 1;
+	int pushedFrames = 0; // frames pushed since the last wakeup
+	// The engine block size that the latency was chosen for. If the engine
+	// block grows, the renderer is restarted with a larger latency.
+	int engineBlockFrames = 0;
+	std::atomic<int> latency{0};
+	RenderFunction render;
+
+	// Enough for the maximum latency with a few channels
+	dsp::RingBuffer<float, 1 << 16> inRing;
+	dsp::RingBuffer<float, 1 << 16> outRing;
+	// only used by the render thread
+	std::vector<float> blockIn;
+	std::vector<float> blockOut;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	// protected by the mutex
+	bool active = false;
+	bool destroying = false;
+	std::atomic<bool> threadRunning{false};
+
+	void renderStep();
+};
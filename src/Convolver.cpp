@@ -0,0 +1,109 @@
+#include "Convolver.hpp"
+#include <algorithm>
+
+// The FFT buffers must be aligned for PFFFT, 16 bytes is enough and that's
+// what malloc returns on all the platforms supported by Rack.
+
+ConvolutionKernel::ConvolutionKernel(int length, float zero) {
+	this->length = length;
+	this->zero = zero;
+	numPartitions = std::max((length + BLOCK_SIZE - 1) / BLOCK_SIZE, 1);
+	spectra.resize(numPartitions * FFT_SIZE, 0.f);
+}
+
+void ConvolutionKernel::setPartitions(const float *x, int first, int last) {
+	dsp::RealFFT fft(FFT_SIZE);
+	std::vector<float> block(FFT_SIZE);
+	float scale = zero < 1.f ? 1.f / (1.f - zero) : 1.f;
+	for(int p = first; p <= last; p++) {
+		// Each partition is zero-padded to the FFT size, so that the circular
+		// convolution of the FFT doesn't wrap around.
+		std::fill(block.begin(), block.end(), 0.f);
+		int n = std::min(BLOCK_SIZE, length - p * BLOCK_SIZE);
+		const float *xp = x + (p - first) * BLOCK_SIZE;
+		for(int i = 0; i < n; i++) {
+			block[i] = (xp[i] - zero) * scale;
+		}
+		fft.rfftUnordered(block.data(), &spectra[p * FFT_SIZE]);
+	}
+}
+
+Convolver::Convolver() {
+	input.resize(ConvolutionKernel::FFT_SIZE, 0.f);
+	output.resize(ConvolutionKernel::BLOCK_SIZE, 0.f);
+	accumulator.resize(ConvolutionKernel::FFT_SIZE, 0.f);
+	work.resize(ConvolutionKernel::FFT_SIZE, 0.f);
+}
+
+void Convolver::reset(ConvolutionKernel *kernel) {
+	numPartitions = kernel->numPartitions;
+	history.swap(kernel->history);
+	std::fill(input.begin(), input.end(), 0.f);
+	std::fill(output.begin(), output.end(), 0.f);
+	std::fill(accumulator.begin(), accumulator.end(), 0.f);
+	int B = ConvolutionKernel::BLOCK_SIZE;
+	partitionsPerSample = (numPartitions - 1 + B - 1) / B;
+	pos = 0;
+	head = 0;
+	nextPartition = 1;
+}
+
+float Convolver::process(float x, ConvolutionKernel *kernel, float &dry) {
+	const int B = ConvolutionKernel::BLOCK_SIZE;
+	if(!kernel) {
+		dry = x;
+		return 0.f;
+	}
+	if(kernel->numPartitions != numPartitions) {
+		if(int(kernel->history.size()) != kernel->numPartitions * ConvolutionKernel::FFT_SIZE) {
+			// The history has already been taken, wait for the next kernel
+			dry = x;
+			return 0.f;
+		}
+		reset(kernel);
+	}
+
+	input[B + pos] = x;
+	dry = input[pos];
+	float y = output[pos];
+
+	for(int n = 0; n < partitionsPerSample && nextPartition < numPartitions; n++) {
+		accumulatePartition(*kernel, nextPartition++);
+	}
+	if(++pos == B) {
+		endBlock(*kernel);
+	}
+	return y;
+}
+
+// Add the product of partition p >= 1 and the input spectrum p - 1 blocks
+// before the newest one to the spectrum of the next output block.
+void Convolver::accumulatePartition(const ConvolutionKernel &kernel, int p) {
+	const int N = ConvolutionKernel::FFT_SIZE;
+	int slot = (head - (p - 1) + numPartitions) % numPartitions;
+	pffft_zconvolve_accumulate(fft.setup, &history[slot * N], kernel.partition(p), accumulator.data(), 1.f / N);
+}
+
+void Convolver::endBlock(const ConvolutionKernel &kernel) {
+	const int B = ConvolutionKernel::BLOCK_SIZE;
+	const int N = ConvolutionKernel::FFT_SIZE;
+	while(nextPartition < numPartitions) {
+		accumulatePartition(kernel, nextPartition++);
+	}
+
+	// The oldest input spectrum is no longer needed, replace it with the
+	// spectrum of the last two blocks.
+	head = (head + 1) % numPartitions;
+	float *spectrum = &history[head * N];
+	fft.rfftUnordered(input.data(), spectrum);
+	pffft_zconvolve_accumulate(fft.setup, spectrum, kernel.partition(0), accumulator.data(), 1.f / N);
+
+	// Overlap-save: the second half of the inverse transform is the linear
+	// convolution, the first half is aliased.
+	fft.irfftUnordered(accumulator.data(), work.data());
+	std::copy(work.begin() + B, work.end(), output.begin());
+	std::copy(input.begin() + B, input.end(), input.begin());
+	std::fill(accumulator.begin(), accumulator.end(), 0.f);
+	pos = 0;
+	nextPartition = 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "plugin.hpp"
+#include <vector>
+
+// Uniformly partitioned FFT convolution, for using an array as an impulse
+// response. The response is split into blocks of BLOCK_SIZE samples, whose
+// spectra are convolved with the spectra of the past input blocks
+// (overlap-save). The latency is one block.
+
+// The spectra of the partitions of an impulse response, in the unordered
+// format of dsp::RealFFT. Built by a worker thread.
+struct ConvolutionKernel {
+	static const int BLOCK_SIZE = 512;
+	static const int FFT_SIZE = 2 * BLOCK_SIZE;
+
+	int length; // length of the impulse response in samples
+	float zero; // array value that corresponds to zero in the response
+	int numPartitions;
+	std::vector<float> spectra;
+	// Zeroed input history for this number of partitions, which the
+	// Convolver swaps with its own when the number of partitions changes,
+	// so that the engine thread doesn't allocate it. Only set in the copies
+	// that are posted to the engine, see allocateHistory().
+	std::vector<float> history;
+
+	// The array values v are mapped to (v - zero) / (1 - zero), so that the
+	// largest value is a unit impulse.
+	ConvolutionKernel(int length, float zero);
+
+	// Compute the spectra of partitions first..last from the array values x,
+	// which start at the beginning of partition 'first'.
+	void setPartitions(const float *x, int first, int last);
+
+	void allocateHistory() {
+		history.assign(numPartitions * FFT_SIZE, 0.f);
+	}
+
+	const float *partition(int p) const {
+		return &spectra[p * FFT_SIZE];
+	}
+};
+
+// The engine side of the convolution, which keeps the spectra of the past
+// input blocks. The products with all partitions except the first only
+// depend on past blocks, so they are spread evenly over the samples of the
+// current block, and only the first partition and the FFTs are computed at
+// the end of the block.
+struct Convolver {
+	dsp::RealFFT fft{ConvolutionKernel::FFT_SIZE};
+	std::vector<float> input; // previous and current input block
+	std::vector<float> output; // output for the current block
+	std::vector<float> history; // ring of input spectra, one per partition
+	std::vector<float> accumulator; // output spectrum of the next block
+	std::vector<float> work;
+	int numPartitions = 0;
+	int partitionsPerSample = 0;
+	int pos = 0; // position in the current block
+	int head = 0; // slot of the newest input spectrum
+	int nextPartition = 1;
+
+	Convolver();
+
+	// Clear the state and take the history of the kernel, which has the
+	// right size for its number of partitions. The old history is left in
+	// the kernel, and freed with it by the worker.
+	void reset(ConvolutionKernel *kernel);
+
+	// Process one sample. Returns the convolved signal, and sets dry to the
+	// input delayed by the same latency. If the kernel has a different number
+	// of partitions than before, the state is reset.
+	float process(float x, ConvolutionKernel *kernel, float &dry);
+
+	void accumulatePartition(const ConvolutionKernel &kernel, int p);
+	void endBlock(const ConvolutionKernel &kernel);
+};
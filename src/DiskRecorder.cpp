@@ -0,0 +1,137 @@
+#include "DiskRecorder.hpp"
+#include "dr_wav.h"
+
+struct DiskRecorder::File {
+	drwav wav;
+	std::vector<float> chunk;
+};
+
+DiskRecorder::DiskRecorder() {
+}
+
+void DiskRecorder::setActive(bool active) {
+	this->active = active;
+	if(active) {
+		// Keep going until the last take has been written after deactivating
+		writer.start([this]() {
+			writerStep();
+			return this->active || state != IDLE;
+		}, 0.02f);
+	}
+}
+
+DiskRecorder::~DiskRecorder() {
+	writer.stop();
+	// finish writing a take that was still in progress
+	if(file) {
+		writerStep();
+		closeFile();
+	}
+}
+
+bool DiskRecorder::start(int channels, float sampleRate) {
+	if(state != IDLE || !active) return false;
+	this->channels = clamp(channels, 1, MAX_POLY_CHANNELS);
+	this->sampleRate = sampleRate;
+	droppedFrames = 0;
+	state = STARTING;
+	return true;
+}
+
+void DiskRecorder::write(const float *frame) {
+	if(ring.capacity() < size_t(channels)) {
+		droppedFrames++;
+		return;
+	}
+	ring.pushBuffer(frame, channels);
+}
+
+void DiskRecorder::stop() {
+	int s = state;
+	if(s == STARTING || s == RECORDING) {
+		state = STOPPING;
+	}
+}
+
+void DiskRecorder::setDirectory(const std::string &dir) {
+	std::lock_guard<std::mutex> lock(pathMutex);
+	directory = dir;
+}
+
+std::string DiskRecorder::getDirectory() {
+	std::lock_guard<std::mutex> lock(pathMutex);
+	return directory;
+}
+
+std::string DiskRecorder::getLastPath() {
+	std::lock_guard<std::mutex> lock(pathMutex);
+	return lastPath;
+}
+
+void DiskRecorder::openFile() {
+	std::string dir = getDirectory();
+	system::createDirectories(dir);
+	// Find the first unused file name
+	std::string path;
+	for(int i = 1; ; i++) {
+		path = system::join(dir, string::f("tape-%03d.wav", i));
+		if(!system::exists(path)) break;
+	}
+
+	drwav_data_format format;
+	format.container = drwav_container_riff;
+	format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+	format.channels = channels;
+	format.sampleRate = sampleRate;
+	format.bitsPerSample = 32;
+
+	file = new File();
+	if(!drwav_init_file_write(&file->wav, path.c_str(), &format)) {
+		WARN("Could not open %s for writing", path.c_str());
+		delete file;
+		file = nullptr;
+		return;
+	}
+	std::lock_guard<std::mutex> lock(pathMutex);
+	lastPath = path;
+}
+
+void DiskRecorder::closeFile() {
+	if(!file) return;
+	drwav_uninit(&file->wav);
+	delete file;
+	file = nullptr;
+}
+
+void DiskRecorder::writerStep() {
+	int s = state;
+	if(s == IDLE) return;
+
+	if(!takeStarted) {
+		takeStarted = true;
+		openFile();
+		int expected = STARTING;
+		state.compare_exchange_strong(expected, RECORDING);
+	}
+
+	// Only take whole frames, the engine may be in the middle of pushing one
+	size_t n = ring.size() / channels * channels;
+	if(n > 0) {
+		if(file) {
+			file->chunk.resize(n);
+			ring.shiftBuffer(file->chunk.data(), n);
+			drwav_write_pcm_frames(&file->wav, n / channels, file->chunk.data());
+		} else {
+			// the file couldn't be opened, just discard the samples
+			for(size_t i = 0; i < n; i++) ring.shift();
+		}
+	}
+
+	// The engine doesn't push anything after stop(), so if the ring buffer
+	// was empty after stopping, the take is complete.
+	if(s == STOPPING && ring.empty()) {
+		closeFile();
+		takeStarted = false;
+		state = IDLE;
+	}
+}
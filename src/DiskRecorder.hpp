@@ -0,0 +1,68 @@
+#pragma once
+#include "plugin.hpp"
+#include "Util.hpp"
+#include <string>
+
+// Streams audio from the engine thread to a float32 wav file. The engine
+// thread only pushes samples into a lock-free ring buffer, and a writer
+// thread opens, appends to and closes the file.
+struct DiskRecorder {
+	DiskRecorder();
+	~DiskRecorder();
+
+	// UI thread: the writer thread only runs while the recorder is active,
+	// and until the last take has been written. Takes can only be started
+	// while active.
+	void setActive(bool active);
+
+	// Engine thread: start a new take. Returns false if the previous take is
+	// still being written, in which case start() should be tried again later.
+	bool start(int channels, float sampleRate);
+	// Engine thread: append one frame of samples (one per channel). If the
+	// writer can't keep up, the frame is dropped.
+	void write(const float *frame);
+	// Engine thread: finish the take, the rest is written in the background.
+	void stop();
+	bool isRecording() const { return state == STARTING || state == RECORDING; }
+
+	// The folder where the takes are written. Can be changed from the UI
+	// thread, takes effect on the next take.
+	void setDirectory(const std::string &dir);
+	std::string getDirectory();
+	// Path of the file of the latest take
+	std::string getLastPath();
+
+	// Number of frames that have been dropped since the start of the take
+	std::atomic<int> droppedFrames{0};
+
+private:
+	enum State {
+		IDLE,
+		STARTING,
+		RECORDING,
+		STOPPING,
+	};
+	std::atomic<int> state{IDLE};
+	std::atomic<bool> active{false};
+	int channels = 1;
+	float sampleRate = 44100.f;
+
+	// About 1.5 s of mono audio at 44.1 kHz. The writer empties it every
+	// 20 ms, so this is plenty even with 16 channels.
+	dsp::RingBuffer<float, 1 << 16> ring;
+
+	std::mutex pathMutex;
+	std::string directory;
+	std::string lastPath;
+
+	struct File;
+	// only used by the writer thread
+	File *file = nullptr;
+	bool takeStarted = false;
+	// Declared last, so that it's stopped before anything it uses is destroyed.
+	PollingThread writer;
+
+	void writerStep();
+	void openFile();
+	void closeFile();
+};
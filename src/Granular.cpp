@@ -0,0 +1,48 @@
+#include "Granular.hpp"
+
+GrainWindow::GrainWindow() {
+	for(int i = 0; i <= SIZE; i++) {
+		table[i] = 0.5f - 0.5f * std::cos(2.f * M_PI * i / SIZE);
+	}
+}
+
+void GrainVoice::reset() {
+	for(int g = 0; g < MAX_GRAINS; g++) {
+		positions[g] = 0.f;
+		windowPhases[g] = 1.f;
+		windowDeltas[g] = 0.f;
+	}
+	numActive = 0;
+}
+
+void GrainVoice::start(float position, float windowDelta) {
+	if(numActive >= MAX_GRAINS) return;
+	positions[numActive] = position;
+	windowPhases[numActive] = 0.f;
+	windowDeltas[numActive] = windowDelta;
+	numActive++;
+}
+
+void GrainVoice::advance(int size) {
+	for(int g = 0; g < numActive; g += 4) {
+		float_4 pos = float_4::load(&positions[g]) + 1.f;
+		pos -= simd::ifelse(pos >= size, float_4(size), 0.f);
+		pos.store(&positions[g]);
+		float_4 phase = float_4::load(&windowPhases[g]) + float_4::load(&windowDeltas[g]);
+		phase.store(&windowPhases[g]);
+	}
+
+	// Move the last active grain into the place of each finished one
+	for(int g = 0; g < numActive; ) {
+		if(windowPhases[g] < 1.f) {
+			g++;
+			continue;
+		}
+		numActive--;
+		positions[g] = positions[numActive];
+		windowPhases[g] = windowPhases[numActive];
+		windowDeltas[g] = windowDeltas[numActive];
+		windowPhases[numActive] = 1.f;
+		windowDeltas[numActive] = 0.f;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "plugin.hpp"
+
+using simd::float_4;
+
+// Hann window, precomputed and read with linear interpolation. The phase is
+// in the range 0..1, and the window is zero at both ends.
+struct GrainWindow {
+	static const int SIZE = 512;
+	float table[SIZE + 1];
+
+	GrainWindow();
+
+	float_4 read(float_4 phase) const {
+		float_4 pos = simd::clamp(phase, 0.f, 1.f) * SIZE;
+		float_4 i = simd::fmin(simd::floor(pos), SIZE - 1);
+		float_4 a, b;
+		for(int lane = 0; lane < 4; lane++) {
+			a[lane] = table[int(i[lane])];
+			b[lane] = table[int(i[lane]) + 1];
+		}
+		return a + (b - a) * (pos - i);
+	}
+};
+
+// The grains of one voice. The grain parameters are stored as a structure of
+// arrays, so that they can be processed four at a time, and the active grains
+// are kept at the start of the arrays, so that only they are processed. The
+// inactive slots have a window phase of 1, i.e. the window is zero.
+struct GrainVoice {
+	static const int MAX_GRAINS = 64;
+	alignas(16) float positions[MAX_GRAINS]; // in array elements
+	alignas(16) float windowPhases[MAX_GRAINS];
+	alignas(16) float windowDeltas[MAX_GRAINS];
+	int numActive = 0;
+	float schedulePhase = 1.f; // start a grain immediately
+
+	GrainVoice() { reset(); }
+
+	void reset();
+
+	// Advance the scheduler by one sample. Returns true if a new grain
+	// should be started. density is in grains per second.
+	bool tick(float density, float sampleTime) {
+		schedulePhase += density * sampleTime;
+		if(schedulePhase < 1.f) return false;
+		schedulePhase -= std::floor(schedulePhase);
+		return true;
+	}
+
+	// Start a grain at the given position, lasting 1 / windowDelta samples.
+	// If all grains are in use, the new grain is dropped.
+	void start(float position, float windowDelta);
+
+	// Advance all active grains by one sample, and remove the finished ones.
+	// The grains play at the original speed, wrapping around the end of an
+	// array of the given size.
+	void advance(int size);
+};
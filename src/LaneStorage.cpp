@@ -0,0 +1,30 @@
+#include "LaneStorage.hpp"
+#include <algorithm>
+#include <cstdint>
+
+void LaneStorage::resizeFrom(const LaneStorage &source, int numLanes, int size, float fill) {
+	int newStride = (size + ALIGN - 1) / ALIGN * ALIGN;
+	std::vector<float> newData(numLanes * newStride + ALIGN, fill);
+	uintptr_t address = reinterpret_cast<uintptr_t>(newData.data());
+	size_t newOffset = (ALIGN - (address / sizeof(float)) % ALIGN) % ALIGN;
+
+	int n = std::min(size, source.laneSize);
+	for(int l = 0; l < std::min(numLanes, source.lanes); l++) {
+		std::copy(source.lane(l), source.lane(l) + n, &newData[newOffset + l * newStride]);
+	}
+
+	data.swap(newData);
+	offset = newOffset;
+	stride = newStride;
+	lanes = numLanes;
+	laneSize = size;
+}
+
+void LaneStorage::swap(LaneStorage &other) {
+	// The offset stays valid, since the data isn't moved
+	data.swap(other.data);
+	std::swap(offset, other.offset);
+	std::swap(stride, other.stride);
+	std::swap(lanes, other.lanes);
+	std::swap(laneSize, other.laneSize);
+}
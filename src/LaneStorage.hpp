@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Several arrays (lanes) of equal size, stored one after another in a single
+// allocation (planar layout). Each lane starts at a 64-byte boundary, so that
+// the lanes don't share cache lines.
+struct LaneStorage {
+	LaneStorage() {}
+
+	int numLanes() const { return lanes; }
+	int size() const { return laneSize; }
+
+	float *lane(int l) { return &data[offset + l * stride]; }
+	const float *lane(int l) const { return &data[offset + l * stride]; }
+
+	// Change the number of lanes and their size, keeping the existing
+	// contents. New elements are set to fill. Allocates memory.
+	void resize(int numLanes, int size, float fill) {
+		resizeFrom(*this, numLanes, size, fill);
+	}
+
+	// Like resize(), but the contents are copied from source
+	void resizeFrom(const LaneStorage &source, int numLanes, int size, float fill);
+
+	// Exchange the contents without allocating
+	void swap(LaneStorage &other);
+
+private:
+	static const int ALIGN = 16; // in floats
+	int lanes = 0;
+	int laneSize = 0;
+	int stride = 0;
+	size_t offset = 0;
+	std::vector<float> data;
+};
@@ -0,0 +1,7 @@
+#include "Oversampling.hpp"
+
+namespace oversampling {
+
+constexpr float HalfbandFilter::taps[TAPS];
+
+}
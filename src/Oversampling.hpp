@@ -0,0 +1,172 @@
+#pragma once
+#include "plugin.hpp"
+
+using simd::float_4;
+
+// Polyphase half-band filters for oversampling by 2, 4 or 8, processing four
+// channels at a time. Each factor is a cascade of 2x stages.
+namespace oversampling {
+
+// Compile-time versions of the math functions needed for the filter
+// coefficients, since std::cos is not constexpr.
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double cosSeries(double x2, double term, int n) {
+	return n > 20 ? 0.0 : term + cosSeries(x2, -term * x2 / ((2 * n + 1) * (2 * n + 2)), n + 1);
+}
+
+constexpr double reduceAngle(double x) {
+	return x > PI ? reduceAngle(x - 2 * PI) : x;
+}
+
+constexpr double constCos(double x) {
+	return cosSeries(reduceAngle(x) * reduceAngle(x), 1.0, 0);
+}
+
+// Each of the two polyphase branches of the filter has this many taps. The
+// full filter has 4 * HALF_TAPS - 1 taps, but every other one is zero,
+// except the center tap which is 0.5.
+constexpr int HALF_TAPS = 12;
+constexpr int TAPS = 2 * HALF_TAPS;
+
+// Tap i of the nonzero branch, which is at offset k = 2i - (TAPS - 1) from
+// the center of the full filter: a Blackman windowed sinc with a cutoff at a
+// quarter of the sample rate.
+constexpr double sinHalfPi(int k) {
+	return (k % 4 + 4) % 4 == 1 ? 1.0 : -1.0; // for odd k
+}
+
+constexpr double windowedSinc(int i) {
+	return sinHalfPi(2 * i - (TAPS - 1)) / (PI * (2 * i - (TAPS - 1)))
+		* (0.42 - 0.5 * constCos(2 * PI * (2 * i + 1) / (2 * TAPS))
+			+ 0.08 * constCos(4 * PI * (2 * i + 1) / (2 * TAPS)));
+}
+
+constexpr double windowedSincSum(int i) {
+	return i >= TAPS ? 0.0 : windowedSinc(i) + windowedSincSum(i + 1);
+}
+
+// Normalized for unity gain at DC, together with the center tap
+constexpr float tap(int i) {
+	return 0.5 * windowedSinc(i) / windowedSincSum(0);
+}
+
+struct HalfbandFilter {
+	static constexpr float taps[TAPS] = {
+		tap(0), tap(1), tap(2), tap(3), tap(4), tap(5),
+		tap(6), tap(7), tap(8), tap(9), tap(10), tap(11),
+		tap(12), tap(13), tap(14), tap(15), tap(16), tap(17),
+		tap(18), tap(19), tap(20), tap(21), tap(22), tap(23),
+	};
+
+	// Input history, stored twice so that the last TAPS values are always
+	// contiguous
+	float_4 history[2 * TAPS];
+	int pos;
+	// Delay line for the center tap when downsampling
+	float_4 centerHistory[HALF_TAPS];
+	int centerPos;
+
+	HalfbandFilter() { reset(); }
+
+	void reset() {
+		for(int i = 0; i < 2 * TAPS; i++) history[i] = 0.f;
+		for(int i = 0; i < HALF_TAPS; i++) centerHistory[i] = 0.f;
+		pos = 0;
+		centerPos = 0;
+	}
+
+	void push(float_4 x) {
+		pos = (pos + 1) % TAPS;
+		history[pos] = x;
+		history[pos + TAPS] = x;
+	}
+
+	// The input from n samples ago
+	float_4 delayed(int n) const {
+		return history[pos + TAPS - n];
+	}
+
+	// The nonzero branch of the filter applied to the history
+	float_4 convolve() const {
+		const float_4 *x = &history[pos + 1];
+		float_4 y = 0.f;
+		for(int i = 0; i < TAPS; i++) {
+			y += taps[i] * x[i];
+		}
+		return y;
+	}
+
+	// Upsample x by two: the samples between the original sampling instants
+	// are given by the nonzero branch, the others by the center tap.
+	void upsample(float_4 x, float_4 *out) {
+		push(x);
+		out[0] = 2.f * convolve();
+		out[1] = delayed(HALF_TAPS - 1);
+	}
+
+	// Filter and downsample a pair of samples by two
+	float_4 downsample(const float_4 *in) {
+		// The center tap is HALF_TAPS - 1 samples behind the newest value
+		float_4 center = centerHistory[centerPos];
+		centerHistory[centerPos] = in[0];
+		centerPos = (centerPos + 1) % (HALF_TAPS - 1);
+		push(in[1]);
+		return convolve() + 0.5f * center;
+	}
+};
+
+// Upsamples by FACTOR with log2(FACTOR) cascaded half-band stages. The last
+// stage runs at FACTOR / 2 times the original rate.
+template <int FACTOR>
+struct Upsampler {
+	Upsampler<FACTOR / 2> previous;
+	HalfbandFilter stage;
+
+	void reset() {
+		previous.reset();
+		stage.reset();
+	}
+
+	void process(float_4 x, float_4 *out) {
+		float_4 tmp[FACTOR / 2];
+		previous.process(x, tmp);
+		for(int i = 0; i < FACTOR / 2; i++) {
+			stage.upsample(tmp[i], &out[2 * i]);
+		}
+	}
+};
+
+template <>
+struct Upsampler<1> {
+	void reset() {}
+	void process(float_4 x, float_4 *out) { out[0] = x; }
+};
+
+// Downsamples by FACTOR, in the reverse order of Upsampler
+template <int FACTOR>
+struct Decimator {
+	HalfbandFilter stage;
+	Decimator<FACTOR / 2> next;
+
+	void reset() {
+		stage.reset();
+		next.reset();
+	}
+
+	float_4 process(const float_4 *in) {
+		float_4 tmp[FACTOR / 2];
+		for(int i = 0; i < FACTOR / 2; i++) {
+			tmp[i] = stage.downsample(&in[2 * i]);
+		}
+		return next.process(tmp);
+	}
+};
+
+template <>
+struct Decimator<1> {
+	void reset() {}
+	float_4 process(const float_4 *in) { return in[0]; }
+};
+
+}
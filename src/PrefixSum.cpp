@@ -0,0 +1,40 @@
+#include "PrefixSum.hpp"
+#include <algorithm>
+
+void PrefixSum::resize(int n) {
+	// Use blocks of about sqrt(n) values, so that updating the sums within a
+	// block and the sums of the blocks take about the same time.
+	blockShift = 6;
+	while((1 << (2 * blockShift)) < n) blockShift++;
+	values.assign(n, 0.f);
+	localSums.assign(n + 1, 0.0);
+	blockSums.assign((n >> blockShift) + 1, 0.0);
+}
+
+void PrefixSum::refresh(int lo, int hi) {
+	int n = size();
+	int blockSize = 1 << blockShift;
+
+	// Sums within the modified blocks. Only the sums after lo change.
+	int firstBlock = lo >> blockShift;
+	int lastBlock = (hi - 1) >> blockShift;
+	for(int b = firstBlock; b <= lastBlock; b++) {
+		int start = std::max(b * blockSize, lo);
+		int blockEnd = (b + 1) * blockSize;
+		int end = std::min(blockEnd, n);
+		double sum = localSums[start];
+		for(int i = start; i < end; i++) {
+			sum += values[i];
+			// the start of the next block always has a local sum of zero
+			if(i + 1 < blockEnd) localSums[i + 1] = sum;
+		}
+	}
+
+	// Sums of the blocks after the first modified one
+	for(int b = firstBlock + 1; b < int(blockSums.size()); b++) {
+		int end = b * blockSize;
+		// The sum of block b - 1 is the running sum up to its last value
+		double blockSum = localSums[end - 1] + values[end - 1];
+		blockSums[b] = blockSums[b - 1] + blockSum;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+// Running sums of an array of values, for computing the sum over any range in
+// constant time. The sums are stored in two levels (within blocks and across
+// blocks), so that changing a few values only requires updating O(sqrt(n))
+// sums instead of all of them. This makes it possible to keep the table up to
+// date on the engine thread while recording.
+struct PrefixSum {
+	PrefixSum() {}
+
+	// Set the number of values and reset them to zero. Allocates memory.
+	void resize(int n);
+
+	int size() const { return values.size(); }
+
+	// Sum of the values [0, k), for k in 0..size()
+	double get(int k) const {
+		return blockSums[k >> blockShift] + localSums[k];
+	}
+
+	float value(int i) const { return values[i]; }
+
+	// Recompute the values [lo, hi) with valueAt(i), and update the sums.
+	template <typename F>
+	void update(int lo, int hi, F valueAt) {
+		lo = std::max(lo, 0);
+		hi = std::min(hi, size());
+		if(lo >= hi) return;
+		for(int i = lo; i < hi; i++) {
+			values[i] = valueAt(i);
+		}
+		refresh(lo, hi);
+	}
+
+private:
+	int blockShift = 0;
+	std::vector<float> values;
+	std::vector<double> localSums; // sums from the start of the block
+	std::vector<double> blockSums; // sums up to the start of each block
+
+	void refresh(int lo, int hi);
+};
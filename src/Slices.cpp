@@ -0,0 +1,100 @@
+#include "Slices.hpp"
+#include "plugin.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const int FRAME_SIZE = 1024;
+static const int HOP_SIZE = 256;
+// An onset must be the largest flux within this many frames on both sides
+static const int PEAK_FRAMES = 3;
+// and larger than the local average within this many frames, times a factor
+static const int AVERAGE_FRAMES = 8;
+static const float AVERAGE_FACTOR = 1.5f;
+// Length of the blocks used for finding the start of the attack
+static const int ATTACK_BLOCK = 32;
+
+// Spectral flux of each frame compared to the previous frame
+static std::vector<float> spectralFlux(const float *x, int size, float zero) {
+	dsp::RealFFT fft(FRAME_SIZE);
+	std::vector<float> window(FRAME_SIZE);
+	for(int i = 0; i < FRAME_SIZE; i++) {
+		window[i] = 0.5f - 0.5f * std::cos(2.f * M_PI * i / FRAME_SIZE);
+	}
+
+	int numFrames = (size - FRAME_SIZE) / HOP_SIZE + 1;
+	std::vector<float> frame(FRAME_SIZE), spectrum(FRAME_SIZE);
+	std::vector<float> magnitudes(FRAME_SIZE / 2, 0.f);
+	std::vector<float> flux(numFrames, 0.f);
+	for(int f = 0; f < numFrames; f++) {
+		const float *xf = x + f * HOP_SIZE;
+		for(int i = 0; i < FRAME_SIZE; i++) {
+			frame[i] = (xf[i] - zero) * window[i];
+		}
+		fft.rfft(frame.data(), spectrum.data());
+		// The DC and Nyquist bins are left out
+		float sum = 0.f;
+		for(int k = 1; k < FRAME_SIZE / 2; k++) {
+			float re = spectrum[2 * k];
+			float im = spectrum[2 * k + 1];
+			float m = std::log1p(100.f * std::sqrt(re * re + im * im) / FRAME_SIZE);
+			sum += std::max(m - magnitudes[k], 0.f);
+			magnitudes[k] = m;
+		}
+		flux[f] = f > 0 ? sum : 0.f; // there's no previous frame for the first one
+	}
+	return flux;
+}
+
+// Find the start of the attack near pos: the first block whose level is at
+// least half of the loudest block within half a frame on either side.
+static int attackStart(const float *x, int size, float zero, int pos) {
+	int lo = std::max(pos - FRAME_SIZE / 2, 0);
+	int hi = std::min(pos + FRAME_SIZE / 2, size);
+	std::vector<float> levels;
+	for(int i = lo; i + ATTACK_BLOCK <= hi; i += ATTACK_BLOCK) {
+		float level = 0.f;
+		for(int j = i; j < i + ATTACK_BLOCK; j++) {
+			level += std::fabs(x[j] - zero);
+		}
+		levels.push_back(level);
+	}
+	if(levels.empty()) return pos;
+	float loudest = *std::max_element(levels.begin(), levels.end());
+	for(size_t b = 0; b < levels.size(); b++) {
+		// start one block early, rather than cut off the beginning
+		if(levels[b] >= 0.5f * loudest) return lo + std::max(int(b) - 1, 0) * ATTACK_BLOCK;
+	}
+	return pos;
+}
+
+Slices::Slices(const float *x, int size, float zero) {
+	this->size = size;
+	this->zero = zero;
+	starts.push_back(0);
+	if(size < FRAME_SIZE) return;
+
+	std::vector<float> flux = spectralFlux(x, size, zero);
+	int numFrames = flux.size();
+	float mean = 0.f;
+	for(float v : flux) mean += v;
+	mean /= numFrames;
+
+	for(int f = 1; f < numFrames; f++) {
+		bool peak = flux[f] > mean;
+		float local = 0.f;
+		int count = 0;
+		for(int g = std::max(f - AVERAGE_FRAMES, 0); g <= std::min(f + AVERAGE_FRAMES, numFrames - 1); g++) {
+			if(std::abs(g - f) <= PEAK_FRAMES && flux[g] > flux[f]) peak = false;
+			local += flux[g];
+			count++;
+		}
+		if(!peak || flux[f] < AVERAGE_FACTOR * local / count) continue;
+
+		// The attack enters the second half of the window when the flux
+		// increases the most.
+		int onset = attackStart(x, size, zero, f * HOP_SIZE + FRAME_SIZE / 2);
+		if(onset - starts.back() >= FRAME_SIZE / 2) {
+			starts.push_back(onset);
+		}
+	}
+}
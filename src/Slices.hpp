@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+
+// Onset detection for slicing samples, e.g. drum loops, at the start of each
+// hit. Onsets are detected from the spectral flux, i.e. the increase in the
+// (log-compressed) magnitude spectrum from one frame to the next. Meant to be
+// run on a worker thread.
+struct Slices {
+	int size; // size of the array
+	float zero; // array value that corresponds to 0V
+	// Start of each slice, the first one is always 0
+	std::vector<int> starts;
+
+	Slices(const float *x, int size, float zero);
+
+	int numSlices() const { return starts.size(); }
+
+	// Start and end (exclusive) of slice n, in elements
+	int start(int n) const { return starts[n]; }
+	int end(int n) const { return n + 1 < numSlices() ? starts[n + 1] : size; }
+};
@@ -0,0 +1,128 @@
+#include "Spectral.hpp"
+#include "Util.hpp"
+
+namespace spectral {
+
+size_t fftSize(size_t n) {
+	size_t N = 32;
+	while(N < n) N *= 2;
+	return N;
+}
+
+// Multiply the spectrum a by b in place. Both are in the ordered format of
+// dsp::RealFFT::rfft(): the real parts of the DC and Nyquist bins come first,
+// followed by interleaved real and imaginary parts of the other bins.
+static void multiplySpectra(float *a, const float *b, size_t N) {
+	a[0] *= b[0];
+	a[1] *= b[1];
+	for(size_t i = 2; i < N; i += 2) {
+		float re = a[i] * b[i] - a[i + 1] * b[i + 1];
+		float im = a[i] * b[i + 1] + a[i + 1] * b[i];
+		a[i] = re;
+		a[i + 1] = im;
+	}
+}
+
+std::vector<float> convolve(const std::vector<float> &x, const std::vector<float> &h) {
+	size_t m = h.size();
+	if(m == 0 || x.size() < m) return std::vector<float>();
+
+	// Use large enough blocks so that the per-block overhead doesn't dominate
+	// for short kernels, but no larger than necessary for short inputs.
+	size_t N = std::min(fftSize(std::max<size_t>(2 * m, 4096)), fftSize(x.size() + m));
+	size_t L = N - m + 1; // number of new input samples per block
+	dsp::RealFFT fft(N);
+
+	std::vector<float> block(N, 0.f), spectrum(N), kernelSpectrum(N);
+	std::copy(h.begin(), h.end(), block.begin());
+	fft.rfft(block.data(), kernelSpectrum.data());
+
+	std::vector<float> acc(x.size() + N, 0.f);
+	for(size_t start = 0; start < x.size(); start += L) {
+		size_t len = std::min(L, x.size() - start);
+		std::fill(block.begin(), block.end(), 0.f);
+		std::copy(x.begin() + start, x.begin() + start + len, block.begin());
+		fft.rfft(block.data(), spectrum.data());
+		multiplySpectra(spectrum.data(), kernelSpectrum.data(), N);
+		fft.irfft(spectrum.data(), block.data());
+		for(size_t i = 0; i < N; i++) {
+			acc[start + i] += block[i];
+		}
+	}
+
+	std::vector<float> y(acc.begin() + (m - 1), acc.begin() + x.size());
+	float a = 1.f / N; // the inverse FFT is not normalized
+	for(float &v : y) v *= a;
+	return y;
+}
+
+std::vector<float> lowpassKernel(float cutoff) {
+	cutoff = clamp(cutoff, 1e-5f, 0.5f);
+	// Transition band width in cycles per sample. A Blackman window has a
+	// transition of roughly 6 / M for a kernel of length M.
+	float transition = std::max(std::min(cutoff, 0.5f - cutoff), 1e-4f);
+	int half = clamp(int(std::ceil(3.f / transition)), 7, 16383);
+	int M = 2 * half + 1;
+
+	std::vector<float> h(M);
+	double sum = 0.0;
+	for(int i = 0; i < M; i++) {
+		float t = i - half;
+		float sinc = t == 0 ? 2.f * cutoff : std::sin(2.f * M_PI * cutoff * t) / (M_PI * t);
+		float p = i * 1.f / (M - 1);
+		float window = 0.42f - 0.5f * std::cos(2.f * M_PI * p) + 0.08f * std::cos(4.f * M_PI * p);
+		h[i] = sinc * window;
+		sum += h[i];
+	}
+	for(float &v : h) v /= sum;
+	return h;
+}
+
+std::vector<float> highpassKernel(float cutoff) {
+	std::vector<float> h = lowpassKernel(cutoff);
+	for(float &v : h) v = -v;
+	h[h.size() / 2] += 1.f;
+	return h;
+}
+
+std::vector<float> gaussianKernel(float sigma) {
+	sigma = std::max(sigma, 0.1f);
+	int half = std::min(int(std::ceil(4.f * sigma)), 65535);
+	std::vector<float> h(2 * half + 1);
+	double sum = 0.0;
+	for(int i = -half; i <= half; i++) {
+		h[i + half] = std::exp(-0.5f * i * i / (sigma * sigma));
+		sum += h[i + half];
+	}
+	for(float &v : h) v /= sum;
+	return h;
+}
+
+std::vector<float> harmonicSum(const std::vector<float> &amplitudes, size_t n, bool cosine) {
+	// Synthesize one period with an inverse FFT of length P >= n, and
+	// resample it to n points if n is not a valid FFT length.
+	size_t P = fftSize(n);
+	std::vector<float> spectrum(P, 0.f), period(P);
+	for(size_t k = 1; k <= amplitudes.size() && 2 * k < n; k++) {
+		// irfft() is unnormalized, so a bin value of a/2 gives an amplitude of a
+		float a = amplitudes[k - 1] * 0.5f;
+		spectrum[2 * k] = cosine ? a : 0.f;
+		spectrum[2 * k + 1] = cosine ? 0.f : -a;
+	}
+	dsp::RealFFT fft(P);
+	fft.irfft(spectrum.data(), period.data());
+	if(P == n) return period;
+	return resamplePeriodic(period.data(), P, n);
+}
+
+std::vector<float> resamplePeriodic(const float *x, size_t n, size_t m) {
+	std::vector<float> y(m);
+	for(size_t i = 0; i < m; i++) {
+		float pos = i * float(n) / m;
+		size_t j = size_t(pos);
+		y[i] = tabread4(x[(j + n - 1) % n], x[j % n], x[(j + 1) % n], x[(j + 2) % n], pos - j);
+	}
+	return y;
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "plugin.hpp"
+#include <vector>
+
+// FFT-based processing of whole arrays, using dsp::RealFFT. These are meant to
+// be run in a BackgroundJob, not on the engine thread.
+namespace spectral {
+
+// Smallest power of two that is >= n, but at least 32 (the minimum length
+// supported by dsp::RealFFT).
+size_t fftSize(size_t n);
+
+// Linear convolution of x with the kernel h using overlap-add. Only the
+// 'valid' part is returned, i.e. x.size() - h.size() + 1 samples, so x should
+// be padded by (h.size() - 1) / 2 samples on both sides for a centered kernel.
+std::vector<float> convolve(const std::vector<float> &x, const std::vector<float> &h);
+
+// Windowed-sinc low-pass kernel (odd length, unity gain at DC). The cutoff is
+// given in cycles per sample, i.e. in the range 0..0.5.
+std::vector<float> lowpassKernel(float cutoff);
+
+// Spectral inversion of lowpassKernel(), unity gain at Nyquist.
+std::vector<float> highpassKernel(float cutoff);
+
+// Normalized gaussian kernel with standard deviation sigma (in samples).
+std::vector<float> gaussianKernel(float sigma);
+
+// Resample one period of a periodic signal x of length n to m points with
+// 4-point interpolation.
+std::vector<float> resamplePeriodic(const float *x, size_t n, size_t m);
+
+// Fill one period of n samples with the sum of harmonics with the given
+// amplitudes, like the sinesum/cosinesum messages of Pd arrays. Harmonics above
+// the Nyquist frequency of the array are dropped. The result is not normalized.
+std::vector<float> harmonicSum(const std::vector<float> &amplitudes, size_t n, bool cosine);
+
+}
@@ -0,0 +1,77 @@
+#include "Terrain.hpp"
+#include "Util.hpp"
+
+Terrain::Terrain(int width, int height) {
+	this->width = width;
+	this->height = height;
+	tilesX = (width + TILE - 1) / TILE;
+	int tilesY = (height + TILE - 1) / TILE;
+	data.resize(tilesX * tilesY * TILE * TILE, 0.f);
+}
+
+void Terrain::setRows(const float *x, int first, int last) {
+	for(int y = first; y <= last; y++) {
+		const float *row = x + (y - first) * width;
+		for(int i = 0; i < width; i++) {
+			int tile = (y >> TILE_SHIFT) * tilesX + (i >> TILE_SHIFT);
+			data[(tile << (2 * TILE_SHIFT)) + ((y & TILE_MASK) << TILE_SHIFT) + (i & TILE_MASK)] = row[i];
+		}
+	}
+}
+
+// Split the position into the integer part in 0..n-1 and the fractional part
+static void split(float_4 pos, int n, float_4 &i, float_4 &frac) {
+	float_4 x = simd::clamp(pos, 0.f, 1.f) * n;
+	i = simd::fmin(simd::floor(x), n - 1);
+	frac = x - i;
+}
+
+// Index i + offset, wrapped to 0..n-1, for offsets in -1..2
+static int wrap(int i, int offset, int n) {
+	i += offset;
+	if(i < 0) return i + n;
+	if(i >= n) return i - n;
+	return i;
+}
+
+float_4 Terrain::readBilinear(float_4 x, float_4 y, float_4 &nearest) const {
+	float_4 ix, fx, iy, fy;
+	split(x, width, ix, fx);
+	split(y, height, iy, fy);
+	float_4 a, b, c, d;
+	for(int lane = 0; lane < 4; lane++) {
+		int x0 = int(ix[lane]);
+		int y0 = int(iy[lane]);
+		int x1 = wrap(x0, 1, width);
+		int y1 = wrap(y0, 1, height);
+		a[lane] = at(x0, y0);
+		b[lane] = at(x1, y0);
+		c[lane] = at(x0, y1);
+		d[lane] = at(x1, y1);
+	}
+	nearest = a;
+	return simd::crossfade(simd::crossfade(a, b, fx), simd::crossfade(c, d, fx), fy);
+}
+
+float_4 Terrain::readBicubic(float_4 x, float_4 y, float_4 &nearest) const {
+	float_4 ix, fx, iy, fy;
+	split(x, width, ix, fx);
+	split(y, height, iy, fy);
+	// Interpolate each of the four rows around the position along x, and then
+	// the results along y.
+	float_4 rows[4];
+	for(int r = 0; r < 4; r++) {
+		float_4 a, b, c, d;
+		for(int lane = 0; lane < 4; lane++) {
+			int x0 = int(ix[lane]);
+			int yr = wrap(int(iy[lane]), r - 1, height);
+			a[lane] = at(wrap(x0, -1, width), yr);
+			b[lane] = at(x0, yr);
+			c[lane] = at(wrap(x0, 1, width), yr);
+			d[lane] = at(wrap(x0, 2, width), yr);
+		}
+		if(r == 1) nearest = b;
+		rows[r] = tabread4(a, b, c, d, fx);
+	}
+	return tabread4(rows[0], rows[1], rows[2], rows[3], fy);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "plugin.hpp"
+#include <vector>
+
+using simd::float_4;
+
+// The array as a two-dimensional grid for wave terrain synthesis. Row r of the
+// grid is elements r * width .. (r + 1) * width - 1 of the array, and the grid
+// wraps around at the edges in both directions.
+//
+// The grid is stored in square tiles of TILE x TILE elements, so that the
+// neighbourhood of an element is in a few cache lines even for wide grids,
+// instead of in separate rows that are far apart in memory.
+struct Terrain {
+	static const int TILE_SHIFT = 3;
+	static const int TILE = 1 << TILE_SHIFT;
+	static const int TILE_MASK = TILE - 1;
+
+	int width;
+	int height;
+	int tilesX; // number of tiles per row of tiles
+	std::vector<float> data;
+
+	Terrain(int width, int height);
+
+	// Copy rows first..last from x, which starts at the beginning of row
+	// 'first'.
+	void setRows(const float *x, int first, int last);
+
+	float at(int x, int y) const {
+		int tile = (y >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT);
+		return data[(tile << (2 * TILE_SHIFT)) + ((y & TILE_MASK) << TILE_SHIFT) + (x & TILE_MASK)];
+	}
+
+	// Read four voices at once. x and y are in the range 0..1. The value of
+	// the element that contains the position is returned in nearest.
+	float_4 readBilinear(float_4 x, float_4 y, float_4 &nearest) const;
+	float_4 readBicubic(float_4 x, float_4 y, float_4 &nearest) const;
+};
@@ -1,4 +1,12 @@
+#pragma once
+#include "plugin.hpp"
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
 
 //sgn() function based on https://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 inline constexpr
@@ -6,6 +14,47 @@ int signum(float val) {
 	return (0.f < val) - (val < 0.f);
 }
 
+// 4-point interpolation between b and c, where frac is in the range 0..1.
+// Based on tabread4_tilde_perform() in
+// https://github.com/pure-data/pure-data/blob/master/src/d_array.c
+// T can be float or simd::float_4.
+template <typename T>
+inline T tabread4(T a, T b, T c, T d, T frac) {
+	// Pd algorithm magic
+	return b + frac * (
+			c - b - 0.1666667f * (1.f - frac) * (
+				(d - a - 3.f * (c - b)) * frac + (d + 2.f * a - 3.f * b)
+				)
+			);
+}
+
+// tabread4() expanded as a polynomial b + k1 x + k2 x^2 + k3 x^3
+template <typename T>
+inline void tabread4Coefficients(T a, T b, T c, T d, T &k1, T &k2, T &k3) {
+	T p = d - a - 3.f * (c - b);
+	T q = d + 2.f * a - 3.f * b;
+	k1 = c - b - q * (1.f / 6.f);
+	k2 = (q - p) * (1.f / 6.f);
+	k3 = p * (1.f / 6.f);
+}
+
+// Derivative of tabread4(a, b, c, d, x) with respect to x at frac
+template <typename T>
+inline T tabread4Slope(T a, T b, T c, T d, T frac) {
+	T k1, k2, k3;
+	tabread4Coefficients(a, b, c, d, k1, k2, k3);
+	return k1 + frac * (2.f * k2 + frac * 3.f * k3);
+}
+
+// Integral of tabread4(a, b, c, d, x) over x from 0 to frac, used for
+// antiderivative anti-aliasing.
+template <typename T>
+inline T tabread4Integral(T a, T b, T c, T d, T frac) {
+	T k1, k2, k3;
+	tabread4Coefficients(a, b, c, d, k1, k2, k3);
+	return frac * (b + frac * (k1 * 0.5f + frac * (k2 * (1.f / 3.f) + frac * k3 * 0.25f)));
+}
+
 // Helper function for adding a small LED to the upper right corner of a port
 // usage in module widget constructor:
 // addChild(createTinyLightForPort(position_of_port_center, ... other params as in createLightCentered() ...))
@@ -42,3 +91,347 @@ struct GUITimer {
 
 	void reset() { status = false; }
 };
+
+struct BackgroundJob {
+	// Runs a single task at a time on a separate thread, so that heavy
+	// operations (e.g. FFT processing of a large array) don't block the UI or
+	// the engine. The task is responsible for handing over its results.
+	std::thread thread;
+	std::atomic<bool> running{false};
+
+	// Start the task, unless a previous one is still running. Returns whether
+	// the task was started.
+	bool start(std::function<void()> task) {
+		if(running) return false;
+		join();
+		running = true;
+		thread = std::thread([this, task]() {
+			task();
+			running = false;
+		});
+		return true;
+	}
+
+	bool isRunning() { return running; }
+
+	void join() {
+		if(thread.joinable()) thread.join();
+	}
+
+	~BackgroundJob() { join(); }
+};
+
+struct PollingThread {
+	// Calls a function periodically on a separate thread. This is used for
+	// background work that is requested by the engine thread, which can only
+	// set a flag, since it shouldn't start threads or wait for a mutex.
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool running = false;
+	bool pollAgain = false;
+
+	// Start polling, unless the thread is already running. The thread exits
+	// when poll returns false, or when stop() is called, and it can then be
+	// started again. Not to be called from the engine thread.
+	void start(std::function<bool()> poll, float interval) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(running) {
+				// the thread may be about to exit, keep it running
+				pollAgain = true;
+				return;
+			}
+		}
+		// the previous thread has exited by itself
+		if(thread.joinable()) thread.join();
+		running = true;
+		pollAgain = false;
+		thread = std::thread([this, poll, interval]() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while(running) {
+				lock.unlock();
+				bool keepPolling = poll();
+				lock.lock();
+				if(!keepPolling && !pollAgain) {
+					running = false;
+					break;
+				}
+				pollAgain = false;
+				cv.wait_for(lock, std::chrono::milliseconds(int(interval * 1000.f)));
+			}
+		});
+	}
+
+	// Poll immediately instead of waiting for the interval to pass. Not to be
+	// called from the engine thread.
+	void wake() {
+		cv.notify_one();
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		cv.notify_one();
+		if(thread.joinable()) thread.join();
+	}
+
+	~PollingThread() { stop(); }
+};
+
+struct SharedWorker {
+	// A single PollingThread for the background work of all modules of the
+	// plugin, so that each module doesn't need a thread of its own. The step
+	// function of each registered module is called in turn, and the thread
+	// only runs while some module is registered. add() and remove() are
+	// called from the UI thread, when modules are created and destroyed.
+	static SharedWorker &get() {
+		static SharedWorker instance;
+		return instance;
+	}
+
+	void add(const void *owner, std::function<void()> step) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			steps.push_back(std::make_pair(owner, step));
+		}
+		if(!running) {
+			thread.start([this]() {
+				poll();
+				return true;
+			}, 0.02f);
+			running = true;
+		}
+	}
+
+	// Once this returns, the step function of the owner is not running and
+	// won't be called again.
+	void remove(const void *owner) {
+		bool empty;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(size_t i = 0; i < steps.size(); i++) {
+				if(steps[i].first == owner) {
+					steps.erase(steps.begin() + i);
+					break;
+				}
+			}
+			empty = steps.empty();
+		}
+		if(empty && running) {
+			thread.stop();
+			running = false;
+		}
+	}
+
+private:
+	std::mutex mutex;
+	std::vector<std::pair<const void*, std::function<void()>>> steps;
+	PollingThread thread;
+	bool running = false; // only used by the UI thread
+
+	void poll() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for(auto &step : steps) {
+			step.second();
+		}
+	}
+};
+
+struct DirtyRange {
+	// The range of indices [lo, hi) of an array that has been modified since
+	// the last call to take(). The range is packed into a single atomic, so
+	// that it can be marked from any thread (including the engine) and taken
+	// by a worker without locking. Indices must fit in 32 bits.
+	std::atomic<uint64_t> range{empty()};
+
+	static uint64_t empty() { return uint64_t(0xffffffff) << 32; } // lo = max, hi = 0
+
+	void mark(size_t lo, size_t hi) {
+		uint64_t r = range.load();
+		uint64_t newRange;
+		do {
+			uint64_t newLo = std::min<uint64_t>(r >> 32, lo);
+			uint64_t newHi = std::max<uint64_t>(r & 0xffffffff, hi);
+			newRange = (newLo << 32) | newHi;
+		} while(newRange != r && !range.compare_exchange_weak(r, newRange));
+	}
+
+	// Get the range and reset it. Returns false if nothing was modified.
+	bool take(size_t &lo, size_t &hi) {
+		uint64_t r = range.exchange(empty());
+		lo = r >> 32;
+		hi = r & 0xffffffff;
+		return lo < hi;
+	}
+};
+
+template <typename T>
+struct Mailbox {
+	// Hands over objects created by a worker thread to the engine thread, so
+	// that the engine thread never allocates or frees them. The engine calls
+	// get(), the worker calls post() and collect().
+	std::atomic<T*> pending{nullptr};
+	std::atomic<T*> retired{nullptr};
+	T *current = nullptr; // only used by the engine thread
+
+	// Engine thread: returns the latest posted object (or nullptr). The
+	// previous object stays valid until the next call to get().
+	T *get() {
+		if(pending.load() && !retired.load()) {
+			T *p = pending.exchange(nullptr);
+			if(p) {
+				retired.store(current);
+				current = p;
+			}
+		}
+		return current;
+	}
+
+	// Worker thread: replace the pending object, the engine picks it up on
+	// the next call to get().
+	void post(T *t) {
+		collect();
+		delete pending.exchange(t);
+	}
+
+	// Worker thread: free the object that the engine has stopped using.
+	void collect() {
+		delete retired.exchange(nullptr);
+	}
+
+	~Mailbox() {
+		delete pending.load();
+		delete retired.load();
+		delete current;
+	}
+};
+
+struct RepostThrottle {
+	// Decides when a worker posts a table that it updates incrementally, so
+	// that the whole table isn't copied on every tick while the array keeps
+	// changing, e.g. while recording. The table is posted once the changes
+	// have stopped for a tick, or at the latest every MAX_TICKS ticks.
+	static const int MAX_TICKS = 10;
+	bool changed = false;
+	int ticks = 0;
+
+	// Call once per tick with whether the table was modified, returns
+	// whether it should be posted.
+	bool tick(bool modified) {
+		if(!modified && !changed) return false;
+		if(!changed) {
+			changed = true;
+			ticks = 0;
+		}
+		ticks++;
+		if(modified && ticks < MAX_TICKS) return false;
+		changed = false;
+		return true;
+	}
+};
+
+struct QualityGovernor {
+	// Keeps the average processing time of a module below a budget, by
+	// stepping down to a lower quality tier when the budget is exceeded, and
+	// back up when there is enough headroom. One sample out of
+	// MEASURE_INTERVAL on average is timed, and the cost is averaged with an
+	// exponential filter. The interval is randomized, so that the timed
+	// samples don't lock to other periodic work, e.g. the control rate
+	// updates of this or other modules. Tier 0 is the highest quality.
+	static const int MEASURE_INTERVAL = 64;
+	// Number of measurements to wait after a change, so that the average
+	// settles to the cost of the new tier (about 0.1 s at 48 kHz)
+	static const int HOLD_MEASUREMENTS = 64;
+	static const int MAX_UP_DELAY = 64 * HOLD_MEASUREMENTS;
+
+	int numTiers = 1;
+	float budget = 0.f; // fraction of the sample period, 0 means off
+	int tier = 0;
+	float averageCost = 0.f; // fraction of the sample period
+	int counter = 0;
+	int interval = MEASURE_INTERVAL;
+	// Bit t is set if tier t gives the same quality as tier t - 1 with the
+	// current settings, such tiers are skipped.
+	uint32_t redundant = 0;
+	int hold = 0;
+	// Measurements to wait before stepping up again. This is doubled every
+	// time stepping up goes over the budget, so that the tier doesn't keep
+	// switching back and forth when the budget is between two tiers.
+	int upWait = 0;
+	int upDelay = HOLD_MEASUREMENTS;
+	bool steppedUp = false;
+	std::chrono::steady_clock::time_point startTime;
+
+	// Returns true if the current sample should be timed, in which case
+	// finish() must be called after processing it. redundantTiers is the
+	// bit mask of tiers that don't change anything, see redundant.
+	bool start(uint32_t redundantTiers) {
+		redundant = redundantTiers;
+		uint32_t allTiers = ((1u << numTiers) - 1) & ~1u;
+		if(budget <= 0.f || (redundant & allTiers) == allTiers) {
+			// Nothing to step down
+			tier = 0;
+			return false;
+		}
+		if(++counter < interval) {
+			return false;
+		}
+		counter = 0;
+		interval = MEASURE_INTERVAL / 2 + random::u32() % MEASURE_INTERVAL;
+		startTime = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	// The next lower and higher tier that changes the quality, or the
+	// current tier if there is none
+	int lowerTier() {
+		for(int t = tier + 1; t < numTiers; t++) {
+			if(!(redundant & (1u << t))) return t;
+		}
+		return tier;
+	}
+
+	int higherTier() {
+		int t = tier > 0 ? tier - 1 : 0;
+		while(t > 0 && (redundant & (1u << t))) t--;
+		return t;
+	}
+
+	void finish(float sampleRate) {
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		averageCost += 0.1f * (seconds * sampleRate - averageCost);
+		if(upWait > 0) upWait--;
+		if(hold > 0) {
+			hold--;
+			return;
+		}
+
+		if(averageCost > budget && lowerTier() != tier) {
+			upDelay = steppedUp ? (2 * upDelay < MAX_UP_DELAY ? 2 * upDelay : MAX_UP_DELAY) : HOLD_MEASUREMENTS;
+			upWait = upDelay;
+			tier = lowerTier();
+			hold = HOLD_MEASUREMENTS;
+			steppedUp = false;
+		} else if(averageCost < 0.5f * budget && tier > 0 && upWait == 0) {
+			tier = higherTier();
+			hold = HOLD_MEASUREMENTS;
+			steppedUp = true;
+		} else {
+			steppedUp = false;
+		}
+	}
+
+	void reset() {
+		tier = 0;
+		averageCost = 0.f;
+		counter = 0;
+		interval = MEASURE_INTERVAL;
+		hold = 0;
+		upWait = 0;
+		upDelay = HOLD_MEASUREMENTS;
+		steppedUp = false;
+	}
+};
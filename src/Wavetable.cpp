@@ -0,0 +1,90 @@
+#include "Wavetable.hpp"
+#include "Spectral.hpp"
+#include "Util.hpp"
+
+Wavetable::Wavetable(int numFrames, int frameSize) {
+	this->numFrames = numFrames;
+	this->frameSize = frameSize;
+	fftSize = spectral::fftSize(frameSize);
+
+	// The last level contains only the fundamental
+	numLevels = 0;
+	frameStride = 0;
+	for(int harmonics = fftSize / 2; harmonics >= 2; harmonics /= 2) {
+		int size = std::max(fftSize >> numLevels, 32);
+		levelOffsets.push_back(frameStride);
+		levelSizes.push_back(size);
+		frameStride += size;
+		numLevels++;
+	}
+	data.resize(frameStride * numFrames, 0.f);
+}
+
+void Wavetable::setFrames(const float *x, int first, int last) {
+	std::vector<dsp::RealFFT*> ffts;
+	for(int l = 0; l < numLevels; l++) {
+		ffts.push_back(new dsp::RealFFT(levelSizes[l]));
+	}
+	std::vector<float> spectrum(fftSize), levelSpectrum(fftSize);
+
+	for(int f = first; f <= last; f++) {
+		std::vector<float> frame = spectral::resamplePeriodic(x + (f - first) * frameSize, frameSize, fftSize);
+		ffts[0]->rfft(frame.data(), spectrum.data());
+
+		for(int l = 0; l < numLevels; l++) {
+			int size = levelSizes[l];
+			int harmonics = (fftSize / 2) >> l;
+			// Copy the bins below the cutoff, scaled by 1/fftSize, since the
+			// transforms are not normalized.
+			float a = 1.f / fftSize;
+			std::fill(levelSpectrum.begin(), levelSpectrum.begin() + size, 0.f);
+			levelSpectrum[0] = spectrum[0] * a;
+			for(int k = 1; k < harmonics; k++) {
+				levelSpectrum[2 * k] = spectrum[2 * k] * a;
+				levelSpectrum[2 * k + 1] = spectrum[2 * k + 1] * a;
+			}
+			ffts[l]->irfft(levelSpectrum.data(), &data[f * frameStride + levelOffsets[l]]);
+		}
+	}
+
+	for(dsp::RealFFT *fft : ffts) delete fft;
+}
+
+float_4 Wavetable::readLevel(float_4 frame, float_4 level, float_4 phase) const {
+	// The table lookups are gathered one voice at a time, the interpolation
+	// is done for all voices at once.
+	float_4 a, b, c, d, frac;
+	for(int i = 0; i < 4; i++) {
+		int l = int(level[i]);
+		int size = levelSizes[l];
+		int mask = size - 1;
+		const float *table = &data[int(frame[i]) * frameStride + levelOffsets[l]];
+		float x = phase[i] * size;
+		int j = int(x);
+		frac[i] = x - j;
+		a[i] = table[(j - 1) & mask];
+		b[i] = table[j & mask];
+		c[i] = table[(j + 1) & mask];
+		d[i] = table[(j + 2) & mask];
+	}
+	return tabread4(a, b, c, d, frac);
+}
+
+float_4 Wavetable::read(float_4 frame, float_4 phase, float_4 delta) const {
+	// Harmonic k of level l is below Nyquist if k * delta < 0.5. Level l has
+	// harmonics below fftSize / 2^(l + 1), so the lowest alias-free level is
+	// log2(fftSize * delta). Crossfade between adjacent levels and frames.
+	float_4 level = simd::clamp(simd::log2(delta * fftSize), 0.f, numLevels - 1.f);
+	float_4 level0 = simd::floor(level);
+	float_4 level1 = simd::fmin(level0 + 1.f, numLevels - 1.f);
+	float_4 levelFrac = level - level0;
+
+	frame = simd::clamp(frame, 0.f, numFrames - 1.f);
+	float_4 frame0 = simd::floor(frame);
+	float_4 frame1 = simd::fmin(frame0 + 1.f, numFrames - 1.f);
+	float_4 frameFrac = frame - frame0;
+
+	float_4 y0 = simd::crossfade(readLevel(frame0, level0, phase), readLevel(frame0, level1, phase), levelFrac);
+	float_4 y1 = simd::crossfade(readLevel(frame1, level0, phase), readLevel(frame1, level1, phase), levelFrac);
+	return simd::crossfade(y0, y1, frameFrac);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "plugin.hpp"
+#include <vector>
+
+using simd::float_4;
+
+// A wavetable made of equally sized single-cycle frames, each of which is
+// stored as a pyramid of band-limited versions (mip levels). Level l contains
+// the harmonics below fftSize / 2^(l + 1), and is stored with a power-of-two
+// length, so that it can be read with masking instead of modulo.
+struct Wavetable {
+	int numFrames;
+	int frameSize; // number of array elements per frame
+	int fftSize; // length of the first mip level
+	int numLevels;
+	size_t frameStride; // number of floats per frame, including all levels
+	std::vector<size_t> levelOffsets;
+	std::vector<int> levelSizes;
+	std::vector<float> data;
+
+	Wavetable(int numFrames, int frameSize);
+
+	// Compute the mip levels of frames first..last from the raw frame data x,
+	// which starts at the beginning of frame 'first'.
+	void setFrames(const float *x, int first, int last);
+
+	// Read four voices at once. frame is the (fractional) frame position in
+	// the range 0..numFrames-1, phase is in the range 0..1 and delta is the
+	// phase increment per sample, which determines the mip level.
+	float_4 read(float_4 frame, float_4 phase, float_4 delta) const;
+
+	float_4 readLevel(float_4 frame, float_4 level, float_4 phase) const;
+};
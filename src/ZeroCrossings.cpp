@@ -0,0 +1,27 @@
+#include "ZeroCrossings.hpp"
+#include <algorithm>
+#include <cmath>
+
+ZeroCrossings::ZeroCrossings(const float *x, int size, float zero) {
+	this->size = size;
+	this->zero = zero;
+	for(int i = 1; i < size; i++) {
+		float prev = x[i - 1] - zero;
+		float cur = x[i] - zero;
+		if((prev < 0.f) != (cur < 0.f)) {
+			indices.push_back(std::fabs(prev) < std::fabs(cur) ? i - 1 : i);
+		}
+	}
+	// Both elements of consecutive crossings can be the same
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
+
+int ZeroCrossings::nearest(float pos) const {
+	if(indices.empty()) return -1;
+	auto it = std::lower_bound(indices.begin(), indices.end(), pos);
+	if(it == indices.end()) return indices.back();
+	if(it == indices.begin()) return *it;
+	int after = *it;
+	int before = *(it - 1);
+	return pos - before < after - pos ? before : after;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+
+// Sorted indices of the elements where an array crosses zero, for snapping
+// positions to the nearest zero crossing in O(log n). Built by a worker
+// thread.
+struct ZeroCrossings {
+	int size; // size of the array
+	float zero; // array value that corresponds to 0V
+	std::vector<int> indices;
+
+	// At each sign change, the element that is closer to zero is used.
+	ZeroCrossings(const float *x, int size, float zero);
+
+	// The zero crossing closest to the position (in elements), or -1 if
+	// there are none.
+	int nearest(float pos) const;
+};
@@ -9,6 +9,7 @@ void init(Plugin *p) {
 
 	// Add all Models defined throughout the plugin
 	p->addModel(modelArray);
+	p->addModel(modelArrayExpander);
 	p->addModel(modelMiniramp);
 	p->addModel(modelMinistep);
 
@@ -10,5 +10,6 @@ extern Plugin *pluginInstance;
 
 // Forward-declare each Model, defined in each module source file
 extern Model *modelArray;
+extern Model *modelArrayExpander;
 extern Model *modelMiniramp;
 extern Model *modelMinistep;